@@ -1,6 +1,7 @@
 #ifndef DB_H
 #define DB_H
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdbool.h>
@@ -9,6 +10,14 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 // Buffer to handle user input
 typedef struct {
@@ -21,7 +30,14 @@ typedef struct {
 typedef enum {
     EXECUTE_SUCCESS,
     EXECUTE_DUPLICATE_KEY,
-    EXECUTE_TABLE_FULL
+    EXECUTE_TABLE_FULL,
+    EXECUTE_INDEX_EXISTS,
+    EXECUTE_TABLE_EXISTS,
+    EXECUTE_TOO_MANY_TABLES,
+    EXECUTE_COLUMN_STORE_EXISTS,
+    EXECUTE_TRANSACTION_OPEN,
+    EXECUTE_NO_TRANSACTION,
+    EXECUTE_IN_TRANSACTION
 } ExecuteResult;
 
 // Meta-command results
@@ -36,99 +52,409 @@ typedef enum {
     PREPARE_SYNTAX_ERROR,
     PREPARE_NEGATIVE_ID,
     PREPARE_STRING_TOO_LONG,
+    PREPARE_UNRECOGNIZED_COLUMN,
+    PREPARE_UNRECOGNIZED_TABLE,
     PREPARE_UNRECOGNIZED_STATEMENT
 } PrepareResult;
 
 // Types of statements
 typedef enum {
     STATEMENT_INSERT,
-    STATEMENT_SELECT
+    STATEMENT_SELECT,
+    STATEMENT_CREATE_INDEX,
+    STATEMENT_CREATE_TABLE,
+    STATEMENT_CREATE_COLUMN_STORE,
+    STATEMENT_BEGIN,
+    STATEMENT_COMMIT,
+    STATEMENT_ROLLBACK
 } StatementType;
 
-// Sizes for columns in the database
+// Sizes for columns of the default users table
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
 
-// Row definition in the table
+// Limits on table definitions
+#define TABLE_MAX_COLUMNS 8
+#define TABLE_NAME_MAX_SIZE 31
+#define COLUMN_NAME_MAX_SIZE 31
+#define COLUMN_TEXT_MAX_SIZE 255
+#define DEFAULT_TABLE_NAME "users" // target of statements that name no table
+#define TABLE_MAX_KEY_SIZE (TABLE_MAX_COLUMNS * sizeof(uint64_t))
+
+// Types a column can be declared with
+typedef enum {
+    COLUMN_TYPE_INT,
+    COLUMN_TYPE_TEXT,
+    COLUMN_TYPE_BIGINT,
+    COLUMN_TYPE_DICT_TEXT // text stored as a code into the column's dictionary
+} ColumnType;
+
+typedef struct {
+    char name[COLUMN_NAME_MAX_SIZE + 1];
+    ColumnType type;
+    uint32_t size; // 4 for int, 8 for bigint, max length + 1 for text
+} ColumnDef;
+
+// A single column value of a decoded row
 typedef struct {
-    uint32_t id;
-    char username[COLUMN_USERNAME_SIZE + 1];
-    char email[COLUMN_EMAIL_SIZE + 1];
+    uint64_t integer;
+    char text[COLUMN_TEXT_MAX_SIZE + 1];
+} Value;
+
+// Row decoded into one value per schema column
+typedef struct {
+    Value values[TABLE_MAX_COLUMNS];
 } Row;
 
+typedef struct Schema Schema;
+
+// Row codec functions, chosen once per schema
+typedef void (*RowEncoder)(Schema* schema, Row* source, void* destination);
+typedef void (*RowDecoder)(Schema* schema, void* source, Row* destination);
+
+// Column layout of a table. The primary key is made of the leading
+// num_key_columns columns, which are ints or bigints.
+struct Schema {
+    uint32_t num_columns;
+    ColumnDef columns[TABLE_MAX_COLUMNS];
+    uint32_t offsets[TABLE_MAX_COLUMNS]; // position of each column in a serialized row
+    uint32_t row_size;
+    uint32_t num_key_columns;
+    uint32_t key_size; // bytes in the normalized key
+    RowEncoder encode;
+    RowDecoder decode;
+};
+
+// Access methods available for an index
+typedef enum {
+    INDEX_BTREE,
+    INDEX_HASH
+} IndexType;
+
+// Position of a column in its table's schema, usable as a bit position in a column mask
+typedef uint32_t Column;
+
+#define KEY_COLUMN 0 // leading column of the primary key
+#define COLUMN_MASK(column) (1u << (column))
+#define MAX_SELECT_COLUMNS TABLE_MAX_COLUMNS
+
+// Aggregate functions computed in-engine; min, max and sum take an int column
+typedef enum {
+    AGGREGATE_COUNT,
+    AGGREGATE_MIN,
+    AGGREGATE_MAX,
+    AGGREGATE_SUM
+} Aggregate;
+
+typedef struct Table Table;
+
 // Statement type (insert or select) and the row to insert
 typedef struct {
     StatementType type;
+    Table* table; // table the statement runs against
     Row row_to_insert; // only used by insert statement
+    uint32_t num_columns; // only used by select statement
+    Column columns[MAX_SELECT_COLUMNS]; // projected columns in output order
+    uint32_t column_mask; // union of projected columns, pushed into the scan
+    uint32_t num_aggregates; // only used by aggregate selects
+    Aggregate aggregates[MAX_SELECT_COLUMNS];
+    Column aggregate_columns[MAX_SELECT_COLUMNS];
+    bool has_order_by; // only set when ordering by a non-key column
+    Column order_by;
+    bool has_limit;
+    uint32_t limit;
+    uint32_t offset;
+    bool has_where; // single predicate: column = value, or column like 'prefix%'
+    Column where_column;
+    bool where_is_prefix;
+    uint64_t where_integer; // value for an int or bigint column
+    char where_value[COLUMN_TEXT_MAX_SIZE + 1]; // value for a text column
+    char* where_dictionary_value; // interned where_value of a dictionary column, set at execution
+    IndexType index_type; // only used by create index statement
+    Column index_column;
+    uint32_t index_include_mask; // extra columns stored in the index leaves
+    bool explain; // print the chosen access path instead of running a select
+    char table_name[TABLE_NAME_MAX_SIZE + 1]; // only used by create table
+    Schema schema;
 } Statement;
 
-// Macro to get the size of a struct's attribute
-#define size_of_attribute(Struct, Attribute) sizeof(((Struct*)0)->Attribute)
-
-// Declare constants to be used for row sizes, offsets, and page sizes
-extern const uint32_t ID_SIZE;
-extern const uint32_t USERNAME_SIZE;
-extern const uint32_t EMAIL_SIZE;
-extern const uint32_t ID_OFFSET;
-extern const uint32_t USERNAME_OFFSET;
-extern const uint32_t EMAIL_OFFSET;
-extern const uint32_t ROW_SIZE;
+// Declare constants for column sizes in a serialized row
+extern const uint32_t COLUMN_INT_SIZE;
+extern const uint32_t COLUMN_BIGINT_SIZE;
+extern const uint32_t COLUMN_DICT_CODE_SIZE;
 
 // Declare constants for common node header layout
 extern const uint32_t NODE_TYPE_SIZE;
 extern const uint32_t NODE_TYPE_OFFSET;
 extern const uint32_t IS_ROOT_SIZE;
 extern const uint32_t IS_ROOT_OFFSET;
-extern const uint32_t PARENT_POINTER_SIZE;
-extern const uint32_t PARENT_POINTER_OFFSET;
+extern const uint32_t RIGHT_LINK_SIZE;
+extern const uint32_t RIGHT_LINK_OFFSET;
 extern const uint32_t COMMON_NODE_HEADER_SIZE;
 
 // Declare constants for leaf node header layout
 extern const uint32_t LEAF_NODE_NUM_CELLS_SIZE;
 extern const uint32_t LEAF_NODE_NUM_CELLS_OFFSET;
+extern const uint32_t LEAF_NODE_BLOOM_SIZE;
+extern const uint32_t LEAF_NODE_BLOOM_OFFSET;
+extern const uint32_t LEAF_NODE_KEY_SIZE_SIZE;
+extern const uint32_t LEAF_NODE_KEY_SIZE_OFFSET;
+extern const uint32_t LEAF_NODE_PREFIX_SIZE_SIZE;
+extern const uint32_t LEAF_NODE_PREFIX_SIZE_OFFSET;
+extern const uint32_t LEAF_NODE_VALUE_SIZE_SIZE;
+extern const uint32_t LEAF_NODE_VALUE_SIZE_OFFSET;
 extern const uint32_t LEAF_NODE_HEADER_SIZE;
 
 // Declare constants for leaf node body layout
-extern const uint32_t LEAF_NODE_KEY_SIZE;
 extern const uint32_t LEAF_NODE_KEY_OFFSET;
-extern const uint32_t LEAF_NODE_VALUE_SIZE;
-extern const uint32_t LEAF_NODE_VALUE_OFFSET;
-extern const uint32_t LEAF_NODE_CELL_SIZE;
 extern const uint32_t LEAF_NODE_SPACE_FOR_CELLS;
-extern const uint32_t LEAF_NODE_MAX_CELLS;
-
-// Declare constants for leaf node split
-extern const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT;
-extern const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT;
 
 // Declare constants for internal node header layout
 extern const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE;
 extern const uint32_t INTERNAL_NODE_NUM_KEYS_OFFSET;
 extern const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE;
 extern const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET;
+extern const uint32_t INTERNAL_NODE_KEY_SIZE_SIZE;
+extern const uint32_t INTERNAL_NODE_KEY_SIZE_OFFSET;
+extern const uint32_t INTERNAL_NODE_LEVEL_SIZE;
+extern const uint32_t INTERNAL_NODE_LEVEL_OFFSET;
 extern const uint32_t INTERNAL_NODE_HEADER_SIZE;
 
 // Declare constants for internal node body layout
-extern const uint32_t INTERNAL_NODE_KEY_SIZE;
 extern const uint32_t INTERNAL_NODE_CHILD_SIZE;
-extern const uint32_t INTERNAL_NODE_CELL_SIZE;
+
+// Declare constants for index node layout (variable-length cells)
+extern const uint32_t INDEX_NODE_NUM_CELLS_SIZE;
+extern const uint32_t INDEX_NODE_NUM_CELLS_OFFSET;
+extern const uint32_t INDEX_NODE_CONTENT_START_SIZE;
+extern const uint32_t INDEX_NODE_CONTENT_START_OFFSET;
+extern const uint32_t INDEX_NODE_RIGHT_POINTER_SIZE;
+extern const uint32_t INDEX_NODE_RIGHT_POINTER_OFFSET;
+extern const uint32_t INDEX_NODE_HEADER_SIZE;
+extern const uint32_t INDEX_NODE_SLOT_SIZE;
+extern const uint32_t INDEX_LEAF_CELL_HEADER_SIZE;
+extern const uint32_t INDEX_INTERNAL_CELL_HEADER_SIZE;
+extern const uint32_t INDEX_MAX_CELL_SIZE;
+
+// Declare constants for hash index layout
+extern const uint32_t HASH_DIRECTORY_GLOBAL_DEPTH_OFFSET;
+extern const uint32_t HASH_DIRECTORY_KEY_SIZE_OFFSET;
+extern const uint32_t HASH_DIRECTORY_HEADER_SIZE;
+extern const uint32_t HASH_DIRECTORY_SLOT_SIZE;
+extern const uint32_t HASH_DIRECTORY_MAX_DEPTH;
+extern const uint32_t HASH_BUCKET_LOCAL_DEPTH_OFFSET;
+extern const uint32_t HASH_BUCKET_NUM_ENTRIES_OFFSET;
+extern const uint32_t HASH_BUCKET_KEY_SIZE_OFFSET;
+extern const uint32_t HASH_BUCKET_VALUE_SIZE_OFFSET;
+extern const uint32_t HASH_BUCKET_HEADER_SIZE;
+
+// Declare constants for the database header (page 0)
+extern const uint32_t DB_HEADER_MAGIC;
+extern const uint32_t DB_HEADER_MAGIC_OFFSET;
+extern const uint32_t DB_HEADER_CATALOG_ROOT_OFFSET;
+
+// Declare constants for catalog entry layout
+extern const uint32_t CATALOG_ROOT_PAGE_OFFSET;
+extern const uint32_t CATALOG_NUM_COLUMNS_OFFSET;
+extern const uint32_t CATALOG_COLUMNS_OFFSET;
+extern const uint32_t CATALOG_COLUMN_SIZE;
+extern const uint32_t CATALOG_NUM_INDEXES_OFFSET;
+extern const uint32_t CATALOG_INDEXES_OFFSET;
+extern const uint32_t CATALOG_INDEX_ENTRY_SIZE;
+extern const uint32_t CATALOG_NUM_KEY_COLUMNS_OFFSET;
+extern const uint32_t CATALOG_COLUMN_STORE_OFFSET;
+extern const uint32_t CATALOG_ENTRY_SIZE;
+
+// Declare constants for the columnar replica
+extern const uint32_t COLUMN_STORE_NUM_ROWS_OFFSET;
+extern const uint32_t COLUMN_STORE_STALE_OFFSET;
+extern const uint32_t COLUMN_STORE_LAST_KEY_OFFSET;
+extern const uint32_t COLUMN_STORE_SEGMENTS_OFFSET;
+extern const uint32_t COLUMN_STORE_SEGMENT_ENTRY_SIZE;
+extern const uint32_t SEGMENT_NEXT_OFFSET;
+extern const uint32_t SEGMENT_FIRST_ROW_OFFSET;
+extern const uint32_t SEGMENT_NUM_VALUES_OFFSET;
+extern const uint32_t SEGMENT_CONTENT_START_OFFSET;
+extern const uint32_t SEGMENT_MIN_OFFSET;
+extern const uint32_t SEGMENT_MAX_OFFSET;
+extern const uint32_t SEGMENT_HEADER_SIZE;
 
 extern const uint32_t PAGE_SIZE;
+extern const uint32_t PAGE_MAP_MAGIC;
+extern const uint32_t PAGE_MAP_MAGIC_OFFSET;
+extern const uint32_t PAGE_MAP_NUM_PAGES_OFFSET;
+extern const uint32_t PAGE_MAP_ENTRIES_OFFSET;
+extern const uint32_t PAGE_MAP_ENTRY_SIZE;
+extern const uint32_t PAGE_MAP_SIZE;
+extern const uint32_t WAL_FRAME_PAGE_NUM_OFFSET;
+extern const uint32_t WAL_FRAME_COMMIT_OFFSET;
+extern const uint32_t WAL_FRAME_LSN_OFFSET;
+extern const uint32_t WAL_FRAME_HEADER_SIZE;
+extern const uint32_t WAL_FRAME_SIZE;
 #define TABLE_MAX_PAGES 100
+#define TABLE_MAX_INDEXES 4
+#define INSERT_MAX_NEW_PAGES 8 // a split on every level of the tree, and a new root
+#define DATABASE_MAX_TABLES 8
+#define INDEX_MAX_DEPTH 16
+#define CHECKPOINT_INTERVAL_MS 10   // between ticks of the checkpointer
+#define CHECKPOINT_PAGES_PER_TICK 8 // pages it writes into the file per tick, at most
+
+// How hard writes are pushed to stable storage, set by .pragma synchronous
+typedef enum {
+    SYNCHRONOUS_OFF,    // never sync, the OS writes pages back when it likes
+    SYNCHRONOUS_NORMAL, // commits, checkpoints and closing sync data only (fdatasync)
+    SYNCHRONOUS_FULL    // they sync data and metadata (fsync)
+} Synchronous;
+extern const char* const SYNCHRONOUS_NAMES[];
 
 // Page structure with number of rows and page size
+// A compressed file starts with a page map giving where each page is stored
+// and how many bytes it takes; a plain file stores page n at n * PAGE_SIZE.
 typedef struct {
     int file_descriptor;
     uint32_t file_length;
     uint32_t num_pages;
     void* pages[TABLE_MAX_PAGES];
+    bool compress;        // write the file compressed on close
+    bool mapped;          // the file on disk is compressed
+    uint32_t num_stored_pages;
+    uint32_t stored_offsets[TABLE_MAX_PAGES];
+    uint32_t stored_sizes[TABLE_MAX_PAGES];
+    uint32_t num_reserved_pages;                // set aside for statements that may allocate pages
+    pthread_mutex_t lock;                       // guards loading pages, num_pages and num_reserved_pages
+    pthread_rwlock_t latches[TABLE_MAX_PAGES]; // one per frame, held while a tree node is read or changed
+    uint64_t versions[TABLE_MAX_PAGES];        // odd while a frame is latched exclusively, bumped on release
+    uint64_t row_versions[TABLE_MAX_PAGES];    // newest row version written to each leaf frame since open
+    void* shadows[TABLE_MAX_PAGES];            // each page as the file holds it, NULL until it is written
+    uint32_t transaction_num_pages;            // pages in the file when the open transaction began
+    Synchronous synchronous;
+    int log_fd;                                // write-ahead log of committed page images
+    char* log_path;
+    pthread_mutex_t checkpoint_lock;           // guards the log and shadows against the checkpointer
+    pthread_cond_t checkpoint_wake;
+    pthread_t checkpointer;
+    bool stopping_checkpointer;
+    uint64_t next_lsn;                         // of the next frame appended to the log
+    uint64_t synced_lsn;                       // frames before it are durable
+    uint64_t checkpoint_lsn;                   // of the log's first frame: pages logged before are in the file
+    uint64_t page_lsns[TABLE_MAX_PAGES];       // frame holding each page's last committed image
+    bool unwritten[TABLE_MAX_PAGES];           // the committed image is not in the file yet
+    uint32_t checkpoint_page;                  // where the checkpointer's sweep resumes
 } Pager;
 
-// Table structure with pages and number of rows
+// A shared latch lets readers in together, an exclusive one admits a single writer
+typedef enum {
+    LATCH_SHARED,
+    LATCH_EXCLUSIVE
+} LatchMode;
+
+// Secondary index. A B-tree index is keyed by (column value, table key) and
+// copies the columns in include_mask into its leaf payload so queries needing
+// only them skip the table. A hash index is keyed by a single-column table key
+// and stores whole rows.
+typedef struct {
+    IndexType type;
+    Column column;
+    uint32_t include_mask;
+    uint32_t root_page_num; // directory page for a hash index
+} Index;
+
+// Distinct values of a dictionary-encoded column, indexed by code. The
+// tree at root_page_num maps each value back to its code.
+typedef struct {
+    uint32_t root_page_num;
+    uint32_t num_values;
+    uint32_t capacity;
+    char** values;
+} Dictionary;
+
+#define VERSION_STORE_BUCKETS 256
+#define VERSION_MAX_SNAPSHOTS 64
+
+// Version of an inserted row, kept while a snapshot older than it is open
+typedef struct RowVersion {
+    uint8_t key[TABLE_MAX_KEY_SIZE];
+    uint64_t version;
+    struct RowVersion* next;
+} RowVersion;
+
+// Row versions of a table and the snapshots open on it (MVCC)
 typedef struct {
+    pthread_mutex_t lock;
+    uint64_t last_version; // version of the last insert
+    uint32_t num_snapshots;
+    uint64_t snapshots[VERSION_MAX_SNAPSHOTS];
+    RowVersion* buckets[VERSION_STORE_BUCKETS];
+} VersionStore;
+
+// Table structure with pages and number of rows
+struct Table {
     Pager* pager;
+    char name[TABLE_NAME_MAX_SIZE + 1];
+    Schema schema;
     uint32_t root_page_num;
-} Table;
+    uint32_t num_indexes;
+    Index indexes[TABLE_MAX_INDEXES];
+    Dictionary* dictionaries[TABLE_MAX_COLUMNS]; // NULL unless the column is dictionary encoded
+    uint32_t column_store_page_num; // directory of the columnar replica, 0 if there is none
+    VersionStore versions;
+};
+
+// Open database file: the tables described by its catalog
+typedef struct {
+    Pager* pager;
+    uint32_t catalog_root_page_num;
+    uint32_t num_tables;
+    Table* tables[DATABASE_MAX_TABLES];
+    pthread_mutex_t parse_lock;  // the parser tokenizes with strtok, so one statement is prepared at a time
+    pthread_rwlock_t lock;       // shared by statements that latch their pages, exclusive for the rest
+    pthread_mutex_t writer_lock; // one insert at a time
+    pthread_mutex_t transaction_lock;  // guards the two fields below
+    bool in_transaction;
+    void* transaction_session; // the session that began the open transaction
+} Database;
+
+// How a statement shares the database with the others running at the same time
+typedef enum {
+    ACCESS_SHARED,   // shared, reads or changes only latched primary tree pages
+    ACCESS_WRITE,    // shared and the single writer, also changes pages that are not latched
+    ACCESS_EXCLUSIVE // alone: changes the catalog, or reads pages that are not latched
+} StatementAccess;
+
+#define SERVER_MAX_WORKERS 16
+#define SERVER_MAX_EVENTS 64
+
+// Client of server mode, sending one statement per line
+typedef struct Connection {
+    int fd;
+    char* pending; // received bytes not yet ended by a newline
+    size_t pending_length;
+    size_t pending_capacity;
+    struct Connection* next; // in the queue of connections with input to serve, or of parked ones
+} Connection;
+
+// Outcome of running one line for a client
+typedef enum {
+    LINE_EXECUTED,
+    LINE_BLOCKED,    // another client's transaction is open, the line is kept for later
+    LINE_CLIENT_GONE
+} LineResult;
+
+// Server mode: an epoll event loop hands readable connections to a worker pool
+typedef struct {
+    Database* db;
+    int listen_fd;
+    int epoll_fd;
+    int signal_fd;
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_ready;
+    Connection* queue_head;
+    Connection* queue_tail;
+    Connection* parked; // connections waiting for another client's transaction to end
+    bool stopping;
+    uint32_t num_workers;
+    pthread_t workers[SERVER_MAX_WORKERS];
+} Server;
 
 // Cursor structure to keep track of the current row
 typedef struct {
@@ -136,8 +462,78 @@ typedef struct {
     uint32_t page_num;
     uint32_t cell_num;
     bool end_of_table; // Indicates a position past the last element
+    LatchMode latch_mode;
+    bool latched;      // the cursor holds a latch on its leaf until it is closed
+    uint8_t* leaf;     // a snapshot cursor reads its own copy of the leaf instead, unlatched
+    uint64_t snapshot; // newest row version a snapshot cursor sees
 } Cursor;
 
+// Number of rows handed out by a single batch scan call
+#define SCAN_BATCH_SIZE 1024
+
+// A value in a batch column: ints by value, strings as pointers into cached pages
+typedef union {
+    uint64_t integer;
+    char* text;
+} BatchValue;
+
+// Column vectors filled by a batch scan, indexed by schema column. Columns
+// are only filled when requested by the scan's column mask.
+typedef struct {
+    uint32_t num_rows;
+    BatchValue columns[TABLE_MAX_COLUMNS][SCAN_BATCH_SIZE];
+} RowBatch;
+
+// Cursor over the cells of an index B-tree, in key order
+typedef struct {
+    Pager* pager;
+    uint32_t page_num;
+    uint32_t cell_num;
+    bool end_of_index;
+} IndexCursor;
+
+// Pages visited on the way down to a leaf, used to propagate splits upward
+typedef struct {
+    uint32_t depth;
+    uint32_t page_nums[INDEX_MAX_DEPTH];
+    uint32_t child_nums[INDEX_MAX_DEPTH]; // child followed at each internal level
+} IndexPath;
+
+// A row kept by the top-K heap. Strings point into cached pages.
+typedef struct {
+    BatchValue values[TABLE_MAX_COLUMNS];
+} RowRef;
+
+// Bounded max-heap keeping the smallest rows by (column, key)
+typedef struct {
+    Schema* schema;
+    Column column;
+    uint32_t capacity;
+    uint32_t size;
+    RowRef* entries;
+} TopKHeap;
+
+// Access paths the planner can choose for a select
+typedef enum {
+    PLAN_FULL_SCAN,
+    PLAN_PRIMARY_KEY,
+    PLAN_PRIMARY_KEY_PREFIX,
+    PLAN_HASH_INDEX,
+    PLAN_INDEX,
+    PLAN_COVERING_INDEX,
+    PLAN_NO_MATCH, // the where value is missing from a dictionary column
+    PLAN_COLUMN_STORE
+} SelectPlan;
+
+// Destination of the rows produced by a select: printed with offset and
+// limit applied, or offered to a top-K heap when ordering by a non-key column
+typedef struct {
+    Statement* statement;
+    TopKHeap* heap;
+    uint32_t to_skip;
+    uint32_t remaining;
+} RowSink;
+
 // Node type for internal nodes and leaf nodes
 typedef enum {
     NODE_INTERNAL,
@@ -149,55 +545,223 @@ InputBuffer* new_input_buffer();
 void print_prompt();
 void read_input(InputBuffer* input_buffer);
 void close_input_buffer(InputBuffer* input_buffer);
+FILE* output_stream();
+void set_output_stream(FILE* stream);
+void set_session(void* session);
+bool process_input(InputBuffer* input_buffer, Database* db);
 
-// Table management functions
-Table* db_open(const char* filename);
-MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table);
-PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement);
-ExecuteResult execute_statement(Statement* statement, Table* table);
+// Server mode functions
+void server_run(Database* db, const char* socket_path);
 
+// Database and catalog functions
+Database* db_open(const char* filename);
+Table* db_find_table(Database* db, const char* name);
+Table* db_create_table(Database* db, const char* name, Schema* schema);
+void catalog_write_table(Database* db, Table* table);
+Index* table_index_on(Table* table, Column column, IndexType type);
+MetaCommandResult do_meta_command(InputBuffer* input_buffer, Database* db);
+PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement, Database* db);
+StatementAccess statement_access(Statement* statement);
+void db_acquire(Database* db, StatementAccess access);
+void db_release(Database* db, StatementAccess access);
+bool db_transaction_blocks(Database* db);
+bool db_try_acquire(Database* db, StatementAccess access);
+void db_end_session(Database* db);
+void db_rollback(Database* db);
+ExecuteResult execute_statement(Statement* statement, Database* db);
+
+// Schema functions
+void schema_add_column(Schema* schema, const char* name, ColumnType type, uint32_t size);
+int32_t schema_find_column(Schema* schema, const char* name);
+uint32_t schema_column_offset(Schema* schema, Column column);
+void schema_set_key_columns(Schema* schema, uint32_t num_key_columns);
+uint32_t schema_key_mask(Schema* schema);
+bool column_is_integer(ColumnDef* column);
+uint32_t column_row_size(ColumnDef* column);
 
 // Row management functions
-void print_row(Row* row);
-void serialize_row(Row* source, void* destination);
-void deserialize_row(void* source, Row* destination);
-void* row_slot(Table* table, uint32_t row_num);
+void print_batch_row(RowBatch* batch, uint32_t index, Statement* statement);
+void serialize_row(Schema* schema, Row* source, void* destination);
+void deserialize_row(Schema* schema, void* source, Row* destination);
+void row_codec_select(Schema* schema);
+void encode_native_int(uint64_t value, uint32_t size, void* destination);
+uint64_t decode_native_int(void* source, uint32_t size);
+
+// Normalized key functions
+void encode_big_endian(uint64_t value, uint32_t size, uint8_t* destination);
+uint64_t decode_big_endian(uint8_t* source, uint32_t size);
+void key_encode(Schema* schema, Row* row, uint8_t* destination);
+uint64_t key_column_decode(Schema* schema, void* key, Column column);
+uint32_t common_prefix_size(uint8_t* a, uint8_t* b, uint32_t size);
+bool key_increment(uint8_t* key, uint32_t size);
+void print_key(Schema* schema, void* key);
+
+// Dictionary functions
+Dictionary* dictionary_new(uint32_t root_page_num);
+void dictionary_free(Dictionary* dictionary);
+void dictionary_load(Pager* pager, Dictionary* dictionary);
+bool dictionary_find(Pager* pager, Dictionary* dictionary, const char* value, uint32_t* code);
+uint32_t dictionary_intern(Pager* pager, Dictionary* dictionary, const char* value);
+void table_create_dictionaries(Table* table);
+void table_free_dictionaries(Table* table);
+void table_reload_dictionaries(Table* table);
+void table_encode_dictionaries(Table* table, Row* row);
+void table_decode_dictionaries(Table* table, Row* row);
+
+// Column store functions
+void column_store_create(Table* table);
+void column_store_refresh(Table* table);
+void column_store_note_insert(Table* table, void* key);
+uint32_t column_store_num_rows(Table* table);
+uint32_t column_store_first_segment(Table* table, Column column);
+uint32_t column_store_last_segment(Table* table, Column column);
+uint32_t* segment_next(void* segment);
+uint32_t* segment_first_row(void* segment);
+uint32_t* segment_num_values(void* segment);
+uint64_t* segment_min(void* segment);
+uint64_t* segment_max(void* segment);
+void column_store_read(Table* table, Column column, uint32_t* page_num, uint32_t row, uint32_t count, BatchValue* values);
+bool column_store_aggregate(Table* table, Aggregate aggregate, Column column, uint64_t* result);
+
+// Page compression functions
+uint32_t page_compress(const uint8_t* source, uint32_t size, uint8_t* destination, uint32_t capacity);
+bool page_decompress(const uint8_t* source, uint32_t size, uint8_t* destination, uint32_t capacity);
 
 // Pager functions
 void* get_page(Pager* pager, uint32_t page_num);
 Pager* pager_open(const char* filename);
 uint32_t get_unused_page_num(Pager* pager);
-void db_close(Table* table);
+bool pager_reserve(Pager* pager, uint32_t num_pages);
+void pager_unreserve(Pager* pager, uint32_t num_pages);
+void pager_latch(Pager* pager, uint32_t page_num, LatchMode mode);
+void pager_unlatch(Pager* pager, uint32_t page_num);
+uint64_t pager_read_begin(Pager* pager, uint32_t page_num);
+bool pager_read_validate(Pager* pager, uint32_t page_num, uint64_t version);
+void pager_write_back(Pager* pager);
+void pager_sync(Pager* pager, int fd);
+void pager_set_compress(Pager* pager, bool compress);
+bool pager_page_dirty(Pager* pager, uint32_t page_num);
+void pager_mark_clean(Pager* pager, uint32_t page_num, void* page);
+void pager_write(Pager* pager, off_t offset, void* source, uint32_t size);
+void pager_begin(Pager* pager);
+void pager_commit(Pager* pager);
+void pager_rollback(Pager* pager);
+void db_close(Database* db);
+
+// Write-ahead log functions
+void wal_open(Pager* pager, const char* filename);
+void wal_log_dirty_pages(Pager* pager, bool sync);
+void wal_stop_checkpointer(Pager* pager);
+void wal_remove(Pager* pager);
+
+// Row version functions (MVCC)
+void version_store_init(VersionStore* store);
+void version_store_prune(VersionStore* store, uint64_t oldest_snapshot);
+void version_store_free(VersionStore* store);
+uint64_t version_store_stamp(VersionStore* store, void* key, uint32_t key_size);
+bool version_store_visible(VersionStore* store, void* key, uint32_t key_size, uint64_t snapshot);
+uint64_t snapshot_open(VersionStore* store);
+void snapshot_close(VersionStore* store, uint64_t snapshot);
 
 // Cursor functions
 Cursor* table_start(Table* table);
-Cursor* table_find(Table* table, uint32_t key);
+uint32_t table_descend(Table* table, void* key);
+uint32_t table_find_leaf(Table* table, void* key);
+Cursor* table_find(Table* table, void* key);
+Cursor* table_find_existing(Table* table, void* key);
+Cursor* table_find_for_insert(Table* table, void* key, bool* maybe_present);
+void* cursor_leaf(Cursor* cursor);
+void cursor_load_leaf(Cursor* cursor, uint32_t page_num);
 void* cursor_value(Cursor* cursor);
 void cursor_advance(Cursor* cursor);
+void cursor_next_leaf(Cursor* cursor);
+void cursor_close(Cursor* cursor);
+void cursor_skip(Cursor* cursor, uint32_t count);
+uint32_t cursor_next_batch(Cursor* cursor, RowBatch* batch, uint32_t column_mask, uint32_t max_rows);
+
+// Aggregate functions
+uint32_t table_count(Table* table);
+uint64_t table_sum_keys(Table* table);
+bool table_min_key(Table* table, uint64_t* key);
+bool table_max_key(Table* table, uint64_t* key);
+bool table_aggregate(Table* table, Aggregate aggregate, Column column, uint64_t* result);
+
+// Index B-tree functions
+void initialize_index_leaf_node(void* node);
+void initialize_index_internal_node(void* node);
+uint32_t index_key_encode(Schema* schema, Column column, Row* row, uint8_t* destination);
+void* index_key_table_key(Schema* schema, void* key, uint32_t key_size);
+uint32_t index_payload_encode(Schema* schema, uint32_t include_mask, Row* row, uint8_t* destination);
+void index_insert(Pager* pager, uint32_t root_page_num, void* key, uint32_t key_size, void* value, uint32_t value_size);
+IndexCursor* index_seek(Pager* pager, uint32_t root_page_num, void* key, uint32_t key_size);
+void* index_cursor_key(IndexCursor* cursor, uint32_t* key_size);
+void* index_cursor_value(IndexCursor* cursor, uint32_t* value_size);
+void index_cursor_advance(IndexCursor* cursor);
+
+// Hash index functions
+uint32_t hash_key(uint32_t key);
+uint32_t hash_bytes(void* key, uint32_t size);
+void hash_index_initialize(Pager* pager, uint32_t directory_page_num, uint32_t key_size, uint32_t value_size);
+void* hash_index_find(Pager* pager, uint32_t directory_page_num, void* key);
+void hash_index_insert(Pager* pager, uint32_t directory_page_num, void* key, void* value);
+
+// Top-K heap functions
+TopKHeap* top_k_new(Schema* schema, Column column, uint32_t capacity);
+void top_k_offer(TopKHeap* heap, RowBatch* batch, uint32_t index);
+void top_k_sort(TopKHeap* heap);
+void top_k_free(TopKHeap* heap);
 
 // Node functions (B-tree)
-void initialize_leaf_node(void* node);
+void initialize_leaf_node(void* node, uint32_t key_size, uint32_t value_size);
 uint32_t* leaf_node_num_cells(void* node);
+uint8_t* leaf_node_key_size(void* node);
+uint8_t* leaf_node_prefix_size(void* node);
+uint8_t* leaf_node_high_key(void* node);
+uint8_t* leaf_node_prefix(void* node);
+uint32_t leaf_node_suffix_size(void* node);
+uint32_t leaf_node_cell_size(void* node);
+uint32_t leaf_node_max_cells(void* node);
 void* leaf_node_cell(void* node, uint32_t cell_num);
-uint32_t* leaf_node_key(void* node, uint32_t cell_num);
+void* leaf_node_key_suffix(void* node, uint32_t cell_num);
+void leaf_node_read_key(void* node, uint32_t cell_num, uint8_t* destination);
+int leaf_node_key_compare(void* node, uint32_t cell_num, void* key);
 void* leaf_node_value(void* node, uint32_t cell_num);
 void print_leaf_node(void* node);
-void print_constants();
-void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value);
-Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key);
+void leaf_node_bloom_add_suffix(void* node, void* suffix);
+bool leaf_node_bloom_test(void* node, void* key);
+void leaf_node_bloom_rebuild(void* node);
+void print_constants(Table* table);
+void leaf_node_insert(Cursor* cursor, void* key, void* value);
+uint32_t leaf_node_find_cell(void* node, void* key);
+Cursor* leaf_node_find(Table* table, uint32_t page_num, void* key);
 NodeType get_node_type(void* node);
 void set_node_type(void* node, NodeType type);
 void set_node_root(void* node, bool is_root);
-void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level);
+uint32_t* node_right_link(void* node);
+uint32_t node_level(void* node);
+bool node_key_beyond(void* node, void* key);
+void* get_node_high_key(void* node);
+uint32_t node_move_right(Pager* pager, uint32_t page_num, void* key, LatchMode mode);
+void print_tree(Table* table, uint32_t page_num, uint32_t indentation_level);
+uint32_t edge_leaf_page_num(Pager* pager, uint32_t page_num, bool rightmost);
 
 // Internal node functions
-void initialize_internal_node(void* node);
+void initialize_internal_node(void* node, uint32_t key_size, uint32_t level);
 uint32_t* internal_node_num_keys(void* node);
 uint32_t* internal_node_right_child(void* node);
+uint32_t* internal_node_key_size(void* node);
+uint32_t* internal_node_level(void* node);
+uint32_t internal_node_max_keys(void* node);
 uint32_t* internal_node_cell(void* node, uint32_t cell_num);
 uint32_t* internal_node_child(void* node, uint32_t child_num);
-uint32_t* internal_node_key(void* node, uint32_t key_num);
-void internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key);
+void* internal_node_key(void* node, uint32_t key_num);
+void* internal_node_min_key(void* node);
+void* internal_node_max_key(void* node);
+void* internal_node_high_key(void* node);
+uint32_t internal_node_find_child(void* node, void* key);
+void internal_node_insert(void* node, void* separator, uint32_t right_page_num);
+uint32_t internal_node_split(Table* table, uint32_t page_num, uint8_t* separator);
+uint32_t internal_node_find_level(Table* table, uint32_t level, void* key);
+void internal_node_post(Table* table, uint32_t level, uint8_t* separator, uint32_t right_page_num);
 
 #endif // DB_H
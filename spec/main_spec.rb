@@ -50,8 +50,8 @@ describe 'database' do
     script << ".exit"
     result = run_script(script)
     expect(result.last(2)).to match_array([
-      "db > Executed.",
-      "db > Need to implement updating parent after split",
+      "db > Error: Table full.",
+      "db > ",
     ])
   end
 
@@ -133,9 +133,9 @@ describe 'database' do
       "db > Constants:",
       "ROW_SIZE: 293",
       "COMMON_NODE_HEADER_SIZE: 6",
-      "LEAF_NODE_HEADER_SIZE: 10",
+      "LEAF_NODE_HEADER_SIZE: 46",
       "LEAF_NODE_CELL_SIZE: 297",
-      "LEAF_NODE_SPACE_FOR_CELLS: 4086",
+      "LEAF_NODE_SPACE_FOR_CELLS: 4050",
       "LEAF_NODE_MAX_CELLS: 13",
       "db > ",
     ])
@@ -191,4 +191,606 @@ describe 'database' do
       "db > ",
     ])
   end
+
+  it 'selects every row across multiple leaf nodes in key order' do
+    script = (1..20).to_a.reverse.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << "select"
+    script << ".exit"
+    result = run_script(script)
+
+    rows = (1..20).map { |i| "(#{i}, user#{i}, person#{i}@example.com)" }
+    expect(result[20...(result.length)]).to eq([
+      "db > #{rows.first}",
+      *rows[1..],
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'selects only the requested columns' do
+    script = [
+      "insert 1 user1 person1@example.com",
+      "insert 2 user2 person2@example.com",
+      "select id",
+      "select email, id",
+      "select phone",
+      ".exit",
+    ]
+    result = run_script(script)
+    expect(result).to eq([
+      "db > Executed.",
+      "db > Executed.",
+      "db > (1)",
+      "(2)",
+      "Executed.",
+      "db > (person1@example.com, 1)",
+      "(person2@example.com, 2)",
+      "Executed.",
+      "db > Unrecognized column.",
+      "db > ",
+    ])
+  end
+
+  it 'computes aggregates over the key column' do
+    script = ["select count(*), min(id), max(id), sum(id)"]
+    script += (1..20).to_a.reverse.map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << "select count(*), min(id), max(id), sum(id)"
+    script << "select count(*), id"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result.first(2)).to eq([
+      "db > (0, NULL, NULL, NULL)",
+      "Executed.",
+    ])
+    expect(result.last(4)).to eq([
+      "db > (20, 1, 20, 210)",
+      "Executed.",
+      "db > Syntax error. Could not parse statement.",
+      "db > ",
+    ])
+  end
+
+  it 'pages through rows with limit and offset' do
+    script = (1..20).map do |i|
+      "insert #{i} user#{i} person#{i}@example.com"
+    end
+    script << "select id limit 3 offset 15"
+    script << "select id limit 2"
+    script << ".exit"
+    result = run_script(script)
+
+    expect(result.last(8)).to eq([
+      "db > (16)",
+      "(17)",
+      "(18)",
+      "Executed.",
+      "db > (1)",
+      "(2)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'orders by a non-key column with a limit' do
+    script = [
+      "insert 1 carol carol@example.com",
+      "insert 2 alice alice@example.com",
+      "insert 3 dave dave@example.com",
+      "insert 4 bob bob@example.com",
+      "select id, username order by username limit 2 offset 1",
+      ".exit",
+    ]
+    result = run_script(script)
+
+    expect(result.last(4)).to eq([
+      "db > (4, bob)",
+      "(1, carol)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'looks up rows through a secondary index' do
+    result1 = run_script([
+      "insert 1 alice alice@example.com",
+      "insert 2 bob bob@example.com",
+      "select id where email = bob@example.com",
+      "create index on users(email)",
+      "create index on users(email)",
+      "insert 3 bobby bobby@example.com",
+      ".exit",
+    ])
+    expect(result1).to eq([
+      "db > Executed.",
+      "db > Executed.",
+      "db > (2)",
+      "Executed.",
+      "db > Executed.",
+      "db > Error: Index already exists.",
+      "db > Executed.",
+      "db > ",
+    ])
+
+    result2 = run_script([
+      "select where email = bob@example.com",
+      "select id where email like bob%",
+      ".exit",
+    ])
+    expect(result2).to eq([
+      "db > (2, bob, bob@example.com)",
+      "Executed.",
+      "db > (2)",
+      "(3)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'answers queries from a covering index' do
+    script = [
+      "insert 1 alice alice@example.com",
+      "insert 2 bob bob@example.com",
+      "create index on users(email) include (username)",
+      "create index on users(username)",
+      "explain select username where email = bob@example.com",
+      "explain select email where username = bob",
+      "select username where email = bob@example.com",
+      ".exit",
+    ]
+    result = run_script(script)
+    expect(result.last(7)).to eq([
+      "db > SEARCH users USING COVERING INDEX email",
+      "Executed.",
+      "db > SEARCH users USING INDEX username",
+      "Executed.",
+      "db > (bob)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'serves point lookups on id from a hash index' do
+    result1 = run_script([
+      "insert 1 user1 person1@example.com",
+      "insert 2 user2 person2@example.com",
+      "create hash index on users(id)",
+      "create hash index on users(email)",
+      "insert 3 user3 person3@example.com",
+      ".exit",
+    ])
+    expect(result1.last(3)).to eq([
+      "db > Syntax error. Could not parse statement.",
+      "db > Executed.",
+      "db > ",
+    ])
+
+    result2 = run_script([
+      "explain select where id = 3",
+      "select where id = 3",
+      "select where id = 4",
+      ".exit",
+    ])
+    expect(result2).to eq([
+      "db > SEARCH users USING HASH INDEX (id=?)",
+      "Executed.",
+      "db > (3, user3, person3@example.com)",
+      "Executed.",
+      "db > Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'rejects duplicates and misses on id across leaves' do
+    script = [30, 10, 20].flat_map do |base|
+      (1..5).map { |i| "insert #{base + i} user#{i} person#{i}@example.com" }
+    end
+    script += [
+      "insert 32 dup dup@example.com",
+      "insert 1 low low@example.com",
+      "insert 1 low low@example.com",
+      "select where id = 26",
+      "select where id = 99",
+      "select where id = 1",
+      ".exit",
+    ]
+    result = run_script(script)
+    expect(result.last(8)).to eq([
+      "db > Error: Duplicate key.",
+      "db > Executed.",
+      "db > Error: Duplicate key.",
+      "db > Executed.",
+      "db > Executed.",
+      "db > (1, low, low@example.com)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'keeps tables with their own schemas in the catalog' do
+    result1 = run_script([
+      "create table orders (id int, item text(16), quantity int)",
+      "create table orders (id int)",
+      "insert into orders 2 widget 5",
+      "insert into orders 1 gadget 7",
+      "insert into carts 1 widget",
+      "insert 1 user1 person1@example.com",
+      ".exit",
+    ])
+    expect(result1).to eq([
+      "db > Executed.",
+      "db > Error: Table already exists.",
+      "db > Executed.",
+      "db > Executed.",
+      "db > Unrecognized table.",
+      "db > Executed.",
+      "db > ",
+    ])
+
+    result2 = run_script([
+      "select item, quantity from orders",
+      "select from orders where quantity = 5",
+      "select",
+      ".exit",
+    ])
+    expect(result2).to eq([
+      "db > (gadget, 7)",
+      "(widget, 5)",
+      "Executed.",
+      "db > (2, widget, 5)",
+      "Executed.",
+      "db > (1, user1, person1@example.com)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'stores rows of an int-only table' do
+    script = [
+      "create table points (id int, x int, y int)",
+      "insert into points 2 30 40",
+      "insert into points 1 10 20",
+      "create index on points(y) include (x)",
+      "select x from points where y = 40",
+      "select from points",
+      ".exit",
+    ]
+    result = run_script(script)
+    expect(result.last(6)).to eq([
+      "db > (30)",
+      "Executed.",
+      "db > (1, 10, 20)",
+      "(2, 30, 40)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'keys tables on 64-bit and composite primary keys' do
+    script = [
+      "create table events (tenant int, id bigint, note text(16), primary key (tenant, id))",
+      "insert into events 2 1300000000000000001 b",
+      "insert into events 1 1300000000000000002 a",
+      "insert into events 2 5 c",
+      "insert into events 2 5 dup",
+      "select from events where tenant = 2",
+      "explain select from events where tenant = 2",
+      ".btree events",
+      "create table snowflakes (id bigint, name text(8))",
+      "insert into snowflakes 18446744073709551615 last",
+      "select from snowflakes where id = 18446744073709551615",
+      ".exit",
+    ]
+    result = run_script(script)
+    expect(result.last(16)).to eq([
+      "db > Error: Duplicate key.",
+      "db > (2, 5, c)",
+      "(2, 1300000000000000001, b)",
+      "Executed.",
+      "db > SEARCH events USING PRIMARY KEY PREFIX (tenant=?)",
+      "Executed.",
+      "db > Tree:",
+      "- leaf (size 3)",
+      "  - (1, 1300000000000000002)",
+      "  - (2, 5)",
+      "  - (2, 1300000000000000001)",
+      "db > Executed.",
+      "db > Executed.",
+      "db > (18446744073709551615, last)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'packs keys with a shared prefix into fewer nodes' do
+    script = ["create table readings (sensor int, at int, primary key (sensor, at))"]
+    script += (1..400).map { |i| "insert into readings 7 #{i}" }
+    script << "create table tags (id int, name text(32))"
+    script << "create index on tags(name)"
+    script += (1..150).map { |i| "insert into tags #{i} category-#{format('%03d', i * 37 % 150)}-shared-suffix" }
+    script += [
+      ".btree readings",
+      "select id from tags where name = category-149-shared-suffix",
+      "select id from tags where name like category-14%",
+      ".exit",
+    ]
+    result = run_script(script)
+    tree = result.index("db > Tree:")
+    expect(result[tree + 1]).to eq("- leaf (size 400)")
+    expect(result.last(15)).to eq([
+      "  - (7, 400)",
+      "db > (77)",
+      "Executed.",
+      "db > (20)",
+      "(93)",
+      "(16)",
+      "(89)",
+      "(12)",
+      "(85)",
+      "(8)",
+      "(81)",
+      "(4)",
+      "(77)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'stores pages compressed when compression is on' do
+    script = [".compression on"]
+    script += (1..18).map { |i| "insert #{i} user#{i} person#{i}@example.com" }
+    script << ".exit"
+    run_script(script)
+    expect(File.size("test.db") < 4096).to eq(true)
+
+    result = run_script([
+      "select where id = 17",
+      ".compression off",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "db > (17, user17, person17@example.com)",
+      "Executed.",
+      "db > db > ",
+    ])
+    expect(File.size("test.db") % 4096).to eq(0)
+    expect(run_script(["select count(*)", ".exit"])).to eq([
+      "db > (18)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'stores dictionary-encoded text columns as codes' do
+    script = ["create table people (id int, name text(16), domain text(64) dict)"]
+    script += (1..200).map { |i| "insert into people #{i} u#{i} d#{i % 3}.example.com" }
+    script << ".exit"
+    run_script(script)
+
+    result = run_script([
+      "select id from people where domain = d1.example.com limit 3",
+      "explain select from people where domain = nowhere.com",
+      "select from people where domain = nowhere.com",
+      "select from people where id = 200",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "db > (1)",
+      "(4)",
+      "(7)",
+      "Executed.",
+      "db > SEARCH people USING DICTIONARY (domain=?)",
+      "Executed.",
+      "db > Executed.",
+      "db > (200, u200, d2.example.com)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'answers scans and aggregates from a column store' do
+    script = ["create table sales (id int, qty int, region text(12))"]
+    script += (1..200).map { |i| "insert into sales #{i * 2} #{i % 17} r#{i % 5}" }
+    script << "create column store on sales"
+    script << "insert into sales 3 50 late"
+    script << ".exit"
+    run_script(script)
+
+    result = run_script([
+      "explain select sum(qty) from sales",
+      "select sum(qty), min(qty), max(qty), count(*) from sales",
+      "explain select id from sales where qty = 50",
+      "select id, region from sales where qty = 50",
+      "create column store on sales",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "db > AGGREGATE sales USING COLUMN STORE",
+      "Executed.",
+      "db > (1637, 0, 50, 201)",
+      "Executed.",
+      "db > SCAN sales USING COLUMN STORE",
+      "Executed.",
+      "db > (3, late)",
+      "Executed.",
+      "db > Error: Column store already exists.",
+      "db > ",
+    ])
+  end
+
+  it 'commits or rolls back the statements of a transaction together' do
+    script = ["insert 1 user1 person1@example.com", "begin"]
+    script += (2..200).map { |i| "insert #{i} user#{i} person#{i}@example.com" }
+    script += ["select count(*) from users", "rollback", "select count(*) from users", "rollback"]
+    script += ["begin", "insert 2 user2 person2@example.com", "create table t (a int)", "commit", ".exit"]
+    result = run_script(script)
+    expect(result.last(11)).to eq([
+      "db > (200)",
+      "Executed.",
+      "db > Executed.",
+      "db > (1)",
+      "Executed.",
+      "db > Error: No transaction is open.",
+      "db > Executed.",
+      "db > Executed.",
+      "db > Error: Not allowed in a transaction.",
+      "db > Executed.",
+      "db > ",
+    ])
+
+    result = run_script(["begin", "insert 3 user3 person3@example.com", ".exit"])
+    result = run_script(["select id from users", ".exit"])
+    expect(result).to eq([
+      "db > (1)",
+      "(2)",
+      "Executed.",
+      "db > ",
+    ])
+  end
+
+  it 'sets how hard commits sync with a pragma' do
+    result = run_script([
+      ".pragma synchronous",
+      ".pragma synchronous = off",
+      "begin",
+      "insert 1 user1 person1@example.com",
+      "commit",
+      ".pragma synchronous = normal",
+      ".pragma synchronous",
+      ".pragma synchronous = sometimes",
+      ".exit",
+    ])
+    expect(result).to eq([
+      "db > synchronous = full",
+      "db > db > Executed.",
+      "db > Executed.",
+      "db > Executed.",
+      "db > db > synchronous = normal",
+      "db > Unrecognized command '.pragma synchronous = sometimes'",
+      "db > ",
+    ])
+  end
+
+  it 'serves many clients over a unix socket' do
+    require 'socket'
+    socket_path = "test.sock"
+    server = IO.popen(["./build/SimpleSQL", "test.db", "--listen", socket_path])
+    expect(server.gets).to eq("Listening on #{socket_path}\n")
+
+    sessions = (1..4).map do |client|
+      Thread.new do
+        socket = UNIXSocket.new(socket_path)
+        socket.write("insert #{client} user#{client} person#{client}@example.com\n.exit\n")
+        socket.read
+      end
+    end
+    expect(sessions.map(&:value)).to eq(["db > Executed.\ndb > "] * 4)
+
+    socket = UNIXSocket.new(socket_path)
+    socket.write("select from users where id = 3\n.exit\n")
+    expect(socket.read).to eq("db > (3, user3, person3@example.com)\nExecuted.\ndb > ")
+
+    Process.kill("TERM", server.pid)
+    server.close
+    expect(File.exist?(socket_path)).to eq(false)
+
+    result = run_script(["select", ".exit"])
+    expect(result.length).to eq(6)
+  end
+
+  it 'lets readers scan while a writer inserts' do
+    require 'socket'
+    socket_path = "test.sock"
+    server = IO.popen(["./build/SimpleSQL", "test.db", "--listen", socket_path])
+    server.gets
+
+    session = lambda do |lines|
+      socket = UNIXSocket.new(socket_path)
+      socket.write((lines + [".exit"]).join("\n") + "\n")
+      socket.read.split("db > ")
+    end
+    session.call(["create table n (id int, v int)"])
+
+    writer = Thread.new { session.call((1..400).map { |i| "insert into n #{i * 7 % 401} #{i}" }) }
+    readers = (1..3).map do
+      Thread.new { session.call(["select id from n"] * 40) }
+    end
+    writer.join
+    scans = readers.flat_map(&:value).map { |output| output.scan(/\d+/).map(&:to_i) }
+    expect(scans.all? { |ids| ids == ids.sort && ids.uniq == ids }).to eq(true)
+
+    expect(session.call(["select count(*), sum(v) from n"])[1]).to eq("(400, 80200)\nExecuted.\n")
+    Process.kill("TERM", server.pid)
+    server.close
+  end
+
+  it 'lets writers split the tree in parallel' do
+    require 'socket'
+    socket_path = "test.sock"
+    server = IO.popen(["./build/SimpleSQL", "test.db", "--listen", socket_path])
+    server.gets
+
+    session = lambda do |lines|
+      socket = UNIXSocket.new(socket_path)
+      socket.write((lines + [".exit"]).join("\n") + "\n")
+      socket.read.split("db > ")
+    end
+    # Wide keys leave room for few separators, so internal nodes split too
+    session.call(["create table w (a bigint, b bigint, c bigint, d bigint, e bigint, f bigint, g bigint, h bigint, " \
+                  "primary key (a, b, c, d, e, f, g, h))"])
+
+    writers = (0...4).map do |k|
+      Thread.new do
+        session.call((0...400).map { |i| i * 4 + k }.map { |i| "insert into w #{i * 617 % 1601} #{i} 0 0 0 0 0 0" })
+      end
+    end
+    writers.each(&:join)
+    expect(writers.flat_map(&:value).grep(/Error/)).to eq([])
+
+    expect(session.call(["select count(*), sum(b) from w"])[1]).to eq("(1600, 1279200)\nExecuted.\n")
+    keys = session.call(["select a from w"])[1].scan(/\d+/).map(&:to_i)
+    expect(keys).to eq((0...1601).to_a - [1600 * 617 % 1601])
+    expect(session.call([".btree w"])[1].lines.grep(/^  - internal/).size > 1).to eq(true)
+    Process.kill("TERM", server.pid)
+    server.close
+  end
+
+  it 'gives each scan a snapshot of the rows inserted before it' do
+    require 'socket'
+    socket_path = "test.sock"
+    server = IO.popen(["./build/SimpleSQL", "test.db", "--listen", socket_path])
+    server.gets
+
+    session = lambda do |lines|
+      socket = UNIXSocket.new(socket_path)
+      socket.write((lines + [".exit"]).join("\n") + "\n")
+      socket.read.split("db > ")
+    end
+    session.call(["create table t (a int, b int)"])
+
+    # Rows land all over the tree, but b counts them in the order they were inserted
+    writer = Thread.new do
+      session.call((1..800).map { |i| "insert into t #{i * 617 % 1601} #{i}" })
+    end
+    readers = (0...2).map do
+      Thread.new do
+        session.call(["select b from t"] * 40)[1..-1]
+      end
+    end
+    writer.join
+    scans = readers.flat_map(&:value)
+
+    expect(scans.size).to eq(80)
+    scans.each do |scan|
+      inserted = scan.scan(/\d+/).map(&:to_i).sort
+      expect(inserted).to eq((1..inserted.size).to_a)
+    end
+    expect(session.call(["select count(*) from t"])[1]).to eq("(800)\nExecuted.\n")
+    Process.kill("TERM", server.pid)
+    server.close
+  end
 end
@@ -0,0 +1,188 @@
+#include "../include/db.h"
+
+/*
+    Page 0 holds the database header, which points at the catalog: an index
+    B-tree keyed by table name whose entries hold each table's root page,
+    schema, dictionary roots, index definitions and column store. Every table is loaded when the database
+    is opened.
+*/
+
+void* catalog_column(void* entry, uint32_t column_num) {
+    return entry + CATALOG_COLUMNS_OFFSET + column_num * CATALOG_COLUMN_SIZE;
+}
+
+void* catalog_index(void* entry, uint32_t index_num) {
+    return entry + CATALOG_INDEXES_OFFSET + index_num * CATALOG_INDEX_ENTRY_SIZE;
+}
+
+void catalog_entry_encode(Table* table, void* entry) {
+    memset(entry, 0, CATALOG_ENTRY_SIZE);
+    *(uint32_t*)(entry + CATALOG_ROOT_PAGE_OFFSET) = table->root_page_num;
+
+    *(uint32_t*)(entry + CATALOG_NUM_COLUMNS_OFFSET) = table->schema.num_columns;
+    *(uint32_t*)(entry + CATALOG_NUM_KEY_COLUMNS_OFFSET) = table->schema.num_key_columns;
+    *(uint32_t*)(entry + CATALOG_COLUMN_STORE_OFFSET) = table->column_store_page_num;
+    for (uint32_t i = 0; i < table->schema.num_columns; i++) {
+        void* column = catalog_column(entry, i);
+        strcpy(column, table->schema.columns[i].name);
+        *(uint32_t*)(column + COLUMN_NAME_MAX_SIZE + 1) = table->schema.columns[i].type;
+        *(uint32_t*)(column + COLUMN_NAME_MAX_SIZE + 1 + sizeof(uint32_t)) = table->schema.columns[i].size;
+        if (table->dictionaries[i] != NULL) {
+            *(uint32_t*)(column + COLUMN_NAME_MAX_SIZE + 1 + 2 * sizeof(uint32_t)) = table->dictionaries[i]->root_page_num;
+        }
+    }
+
+    *(uint32_t*)(entry + CATALOG_NUM_INDEXES_OFFSET) = table->num_indexes;
+    for (uint32_t i = 0; i < table->num_indexes; i++) {
+        void* index = catalog_index(entry, i);
+        *(uint32_t*)index = table->indexes[i].type;
+        *(uint32_t*)(index + sizeof(uint32_t)) = table->indexes[i].column;
+        *(uint32_t*)(index + 2 * sizeof(uint32_t)) = table->indexes[i].include_mask;
+        *(uint32_t*)(index + 3 * sizeof(uint32_t)) = table->indexes[i].root_page_num;
+    }
+}
+
+void catalog_entry_decode(void* entry, Table* table) {
+    table->root_page_num = *(uint32_t*)(entry + CATALOG_ROOT_PAGE_OFFSET);
+
+    table->schema.num_columns = 0;
+    table->schema.row_size = 0;
+    uint32_t num_columns = *(uint32_t*)(entry + CATALOG_NUM_COLUMNS_OFFSET);
+    for (uint32_t i = 0; i < num_columns; i++) {
+        void* column = catalog_column(entry, i);
+        ColumnType type = *(uint32_t*)(column + COLUMN_NAME_MAX_SIZE + 1);
+        uint32_t size = *(uint32_t*)(column + COLUMN_NAME_MAX_SIZE + 1 + sizeof(uint32_t));
+        schema_add_column(&table->schema, column, type, size);
+
+        table->dictionaries[i] = NULL;
+        if (type == COLUMN_TYPE_DICT_TEXT) {
+            uint32_t root_page_num = *(uint32_t*)(column + COLUMN_NAME_MAX_SIZE + 1 + 2 * sizeof(uint32_t));
+            table->dictionaries[i] = dictionary_new(root_page_num);
+            dictionary_load(table->pager, table->dictionaries[i]);
+        }
+    }
+    schema_set_key_columns(&table->schema, *(uint32_t*)(entry + CATALOG_NUM_KEY_COLUMNS_OFFSET));
+    table->column_store_page_num = *(uint32_t*)(entry + CATALOG_COLUMN_STORE_OFFSET);
+
+    table->num_indexes = *(uint32_t*)(entry + CATALOG_NUM_INDEXES_OFFSET);
+    for (uint32_t i = 0; i < table->num_indexes; i++) {
+        void* index = catalog_index(entry, i);
+        table->indexes[i].type = *(uint32_t*)index;
+        table->indexes[i].column = *(uint32_t*)(index + sizeof(uint32_t));
+        table->indexes[i].include_mask = *(uint32_t*)(index + 2 * sizeof(uint32_t));
+        table->indexes[i].root_page_num = *(uint32_t*)(index + 3 * sizeof(uint32_t));
+    }
+}
+
+// Write the table's definition to its catalog entry, adding the entry for a new table
+void catalog_write_table(Database* db, Table* table) {
+    uint8_t entry[CATALOG_ENTRY_SIZE];
+    catalog_entry_encode(table, entry);
+    uint32_t name_size = strlen(table->name) + 1;
+
+    // Entries have a fixed size, so an existing one is overwritten in place
+    IndexCursor* cursor = index_seek(db->pager, db->catalog_root_page_num, table->name, name_size);
+    if (!cursor->end_of_index) {
+        uint32_t key_size;
+        void* key = index_cursor_key(cursor, &key_size);
+        if (key_size == name_size && memcmp(key, table->name, name_size) == 0) {
+            uint32_t value_size;
+            memcpy(index_cursor_value(cursor, &value_size), entry, CATALOG_ENTRY_SIZE);
+            free(cursor);
+            return;
+        }
+    }
+    free(cursor);
+
+    index_insert(db->pager, db->catalog_root_page_num, table->name, name_size, entry, CATALOG_ENTRY_SIZE);
+}
+
+Table* db_find_table(Database* db, const char* name) {
+    for (uint32_t i = 0; i < db->num_tables; i++) {
+        if (strcmp(db->tables[i]->name, name) == 0) {
+            return db->tables[i];
+        }
+    }
+    return NULL;
+}
+
+Table* db_create_table(Database* db, const char* name, Schema* schema) {
+    Table* table = malloc(sizeof(Table));
+    table->pager = db->pager;
+    version_store_init(&table->versions);
+    strcpy(table->name, name);
+    table->schema = *schema;
+    table->num_indexes = 0;
+    table->column_store_page_num = 0;
+
+    table->root_page_num = get_unused_page_num(db->pager);
+    void* root_node = get_page(db->pager, table->root_page_num);
+    initialize_leaf_node(root_node, schema->key_size, schema->row_size);
+    set_node_root(root_node, true);
+    table_create_dictionaries(table);
+
+    db->tables[db->num_tables++] = table;
+    catalog_write_table(db, table);
+    return table;
+}
+
+Database* db_open(const char* filename) {
+    Pager* pager = pager_open(filename);
+
+    Database* db = malloc(sizeof(Database));
+    db->pager = pager;
+    db->num_tables = 0;
+    pthread_mutex_init(&db->parse_lock, NULL);
+    pthread_rwlock_init(&db->lock, NULL);
+    pthread_mutex_init(&db->writer_lock, NULL);
+    pthread_mutex_init(&db->transaction_lock, NULL);
+    db->in_transaction = false;
+    db->transaction_session = NULL;
+
+    if (pager->num_pages == 0) {
+        // New database file. Page 0 holds the header, page 1 the catalog root
+        void* header = get_page(pager, 0);
+        memset(header, 0, PAGE_SIZE);
+        db->catalog_root_page_num = get_unused_page_num(pager);
+        void* catalog_root = get_page(pager, db->catalog_root_page_num);
+        initialize_index_leaf_node(catalog_root);
+        set_node_root(catalog_root, true);
+
+        *(uint32_t*)(header + DB_HEADER_MAGIC_OFFSET) = DB_HEADER_MAGIC;
+        *(uint32_t*)(header + DB_HEADER_CATALOG_ROOT_OFFSET) = db->catalog_root_page_num;
+
+        // Every database starts out with the users table
+        Schema users;
+        users.num_columns = 0;
+        users.row_size = 0;
+        schema_add_column(&users, "id", COLUMN_TYPE_INT, COLUMN_INT_SIZE);
+        schema_add_column(&users, "username", COLUMN_TYPE_TEXT, COLUMN_USERNAME_SIZE + 1);
+        schema_add_column(&users, "email", COLUMN_TYPE_TEXT, COLUMN_EMAIL_SIZE + 1);
+        db_create_table(db, DEFAULT_TABLE_NAME, &users);
+        return db;
+    }
+
+    void* header = get_page(pager, 0);
+    if (*(uint32_t*)(header + DB_HEADER_MAGIC_OFFSET) != DB_HEADER_MAGIC) {
+        printf("Not a SimpleSQL database file.\n");
+        exit(EXIT_FAILURE);
+    }
+    db->catalog_root_page_num = *(uint32_t*)(header + DB_HEADER_CATALOG_ROOT_OFFSET);
+
+    // The empty key sorts before every table name
+    IndexCursor* cursor = index_seek(pager, db->catalog_root_page_num, "", 0);
+    while (!cursor->end_of_index && db->num_tables < DATABASE_MAX_TABLES) {
+        uint32_t key_size, value_size;
+        Table* table = malloc(sizeof(Table));
+        table->pager = pager;
+        version_store_init(&table->versions);
+        strcpy(table->name, index_cursor_key(cursor, &key_size));
+        catalog_entry_decode(index_cursor_value(cursor, &value_size), table);
+
+        db->tables[db->num_tables++] = table;
+        index_cursor_advance(cursor);
+    }
+    free(cursor);
+
+    return db;
+}
@@ -0,0 +1,149 @@
+#include "../include/db.h"
+
+/*
+    Row codecs. Ints and bigints are stored in native byte order, text in a
+    fixed-width slot of the column's size and a dictionary column as its
+    code, at the offsets precomputed in the schema. A codec is picked once when the schema is built, so
+    encoding or decoding a row never re-interprets the column list:
+    common layouts get straight-line code with compile-time offsets and
+    sizes, anything else walks the offset table.
+*/
+
+#define INT_SIZE sizeof(uint32_t)
+
+// Values are held as 64 bits and narrowed to the column's 4 or 8 bytes
+void encode_native_int(uint64_t value, uint32_t size, void* destination) {
+    if (size == INT_SIZE) {
+        uint32_t narrow = value;
+        memcpy(destination, &narrow, INT_SIZE);
+    } else {
+        memcpy(destination, &value, sizeof(uint64_t));
+    }
+}
+
+uint64_t decode_native_int(void* source, uint32_t size) {
+    if (size == INT_SIZE) {
+        uint32_t narrow;
+        memcpy(&narrow, source, INT_SIZE);
+        return narrow;
+    }
+    uint64_t value;
+    memcpy(&value, source, sizeof(uint64_t));
+    return value;
+}
+
+// Layout of the default users table: id int, username text(32), email text(255)
+#define USERS_USERNAME_OFFSET INT_SIZE
+#define USERS_EMAIL_OFFSET (USERS_USERNAME_OFFSET + COLUMN_USERNAME_SIZE + 1)
+
+void encode_users_row(Schema* schema, Row* source, void* destination) {
+    encode_native_int(source->values[0].integer, INT_SIZE, destination);
+    memcpy(destination + USERS_USERNAME_OFFSET, source->values[1].text, COLUMN_USERNAME_SIZE + 1);
+    memcpy(destination + USERS_EMAIL_OFFSET, source->values[2].text, COLUMN_EMAIL_SIZE + 1);
+}
+
+void decode_users_row(Schema* schema, void* source, Row* destination) {
+    destination->values[0].integer = decode_native_int(source, INT_SIZE);
+    memcpy(destination->values[1].text, source + USERS_USERNAME_OFFSET, COLUMN_USERNAME_SIZE + 1);
+    memcpy(destination->values[2].text, source + USERS_EMAIL_OFFSET, COLUMN_EMAIL_SIZE + 1);
+}
+
+/*
+    Rows made only of ints are packed back to back. One encoder and
+    decoder is generated per column count, so the loop bound is a
+    constant the compiler fully unrolls.
+*/
+#define DEFINE_INT_ROW_CODEC(count)                                                               \
+    void encode_int_row_##count(Schema* schema, Row* source, void* destination) {                 \
+        for (uint32_t i = 0; i < count; i++) {                                                    \
+            encode_native_int(source->values[i].integer, INT_SIZE, destination + i * INT_SIZE);   \
+        }                                                                                         \
+    }                                                                                             \
+    void decode_int_row_##count(Schema* schema, void* source, Row* destination) {                 \
+        for (uint32_t i = 0; i < count; i++) {                                                    \
+            destination->values[i].integer = decode_native_int(source + i * INT_SIZE, INT_SIZE);  \
+        }                                                                                         \
+    }
+
+DEFINE_INT_ROW_CODEC(1)
+DEFINE_INT_ROW_CODEC(2)
+DEFINE_INT_ROW_CODEC(3)
+DEFINE_INT_ROW_CODEC(4)
+DEFINE_INT_ROW_CODEC(5)
+DEFINE_INT_ROW_CODEC(6)
+DEFINE_INT_ROW_CODEC(7)
+DEFINE_INT_ROW_CODEC(8)
+
+RowEncoder int_row_encoders[TABLE_MAX_COLUMNS + 1] = {
+    NULL, encode_int_row_1, encode_int_row_2, encode_int_row_3, encode_int_row_4,
+    encode_int_row_5, encode_int_row_6, encode_int_row_7, encode_int_row_8,
+};
+
+RowDecoder int_row_decoders[TABLE_MAX_COLUMNS + 1] = {
+    NULL, decode_int_row_1, decode_int_row_2, decode_int_row_3, decode_int_row_4,
+    decode_int_row_5, decode_int_row_6, decode_int_row_7, decode_int_row_8,
+};
+
+// Any other layout walks the schema's offset table
+void encode_generic_row(Schema* schema, Row* source, void* destination) {
+    for (Column column = 0; column < schema->num_columns; column++) {
+        void* slot = destination + schema->offsets[column];
+        if (column_is_integer(&schema->columns[column])) {
+            encode_native_int(source->values[column].integer, schema->columns[column].size, slot);
+        } else if (schema->columns[column].type == COLUMN_TYPE_DICT_TEXT) {
+            encode_native_int(source->values[column].integer, COLUMN_DICT_CODE_SIZE, slot);
+        } else {
+            memcpy(slot, source->values[column].text, schema->columns[column].size);
+        }
+    }
+}
+
+void decode_generic_row(Schema* schema, void* source, Row* destination) {
+    for (Column column = 0; column < schema->num_columns; column++) {
+        void* slot = source + schema->offsets[column];
+        if (column_is_integer(&schema->columns[column])) {
+            destination->values[column].integer = decode_native_int(slot, schema->columns[column].size);
+        } else if (schema->columns[column].type == COLUMN_TYPE_DICT_TEXT) {
+            destination->values[column].integer = decode_native_int(slot, COLUMN_DICT_CODE_SIZE);
+        } else {
+            memcpy(destination->values[column].text, slot, schema->columns[column].size);
+        }
+    }
+}
+
+bool schema_is_users_layout(Schema* schema) {
+    return schema->num_columns == 3 && schema->columns[0].type == COLUMN_TYPE_INT &&
+           schema->columns[1].type == COLUMN_TYPE_TEXT && schema->columns[1].size == COLUMN_USERNAME_SIZE + 1 &&
+           schema->columns[2].type == COLUMN_TYPE_TEXT && schema->columns[2].size == COLUMN_EMAIL_SIZE + 1;
+}
+
+bool schema_is_all_ints(Schema* schema) {
+    for (Column column = 0; column < schema->num_columns; column++) {
+        if (schema->columns[column].type != COLUMN_TYPE_INT) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Pick the fastest codec for the schema's current columns
+void row_codec_select(Schema* schema) {
+    if (schema_is_users_layout(schema)) {
+        schema->encode = encode_users_row;
+        schema->decode = decode_users_row;
+    } else if (schema->num_columns > 0 && schema_is_all_ints(schema)) {
+        schema->encode = int_row_encoders[schema->num_columns];
+        schema->decode = int_row_decoders[schema->num_columns];
+    } else {
+        schema->encode = encode_generic_row;
+        schema->decode = decode_generic_row;
+    }
+}
+
+void serialize_row(Schema* schema, Row* source, void* destination) {
+    schema->encode(schema, source, destination);
+}
+
+void deserialize_row(Schema* schema, void* source, Row* destination) {
+    schema->decode(schema, source, destination);
+}
@@ -0,0 +1,317 @@
+#include "../include/db.h"
+
+/*
+    Columnar replica of a table. Every column is kept as its own chain of
+    segment pages, in key order, so an analytical scan or aggregate reads
+    only the columns it needs. Each segment of an int column carries a zone
+    map, the min and max of its values, letting an equality scan or a min
+    or max skip whole segments. The replica is not written on insert: it
+    catches up with the row store in bulk the next time it is read.
+*/
+
+void* column_store_directory(Table* table) {
+    return get_page(table->pager, table->column_store_page_num);
+}
+
+uint32_t* column_store_num_rows_field(void* directory) {
+    return directory + COLUMN_STORE_NUM_ROWS_OFFSET;
+}
+
+uint32_t* column_store_stale(void* directory) {
+    return directory + COLUMN_STORE_STALE_OFFSET;
+}
+
+uint8_t* column_store_last_key(void* directory) {
+    return directory + COLUMN_STORE_LAST_KEY_OFFSET;
+}
+
+uint32_t* column_store_first_segment_field(void* directory, Column column) {
+    return directory + COLUMN_STORE_SEGMENTS_OFFSET + column * COLUMN_STORE_SEGMENT_ENTRY_SIZE;
+}
+
+uint32_t* column_store_last_segment_field(void* directory, Column column) {
+    return column_store_first_segment_field(directory, column) + 1;
+}
+
+uint32_t column_store_num_rows(Table* table) {
+    return *column_store_num_rows_field(column_store_directory(table));
+}
+
+uint32_t column_store_first_segment(Table* table, Column column) {
+    return *column_store_first_segment_field(column_store_directory(table), column);
+}
+
+uint32_t column_store_last_segment(Table* table, Column column) {
+    return *column_store_last_segment_field(column_store_directory(table), column);
+}
+
+uint32_t* segment_next(void* segment) {
+    return segment + SEGMENT_NEXT_OFFSET;
+}
+
+uint32_t* segment_first_row(void* segment) {
+    return segment + SEGMENT_FIRST_ROW_OFFSET;
+}
+
+uint32_t* segment_num_values(void* segment) {
+    return segment + SEGMENT_NUM_VALUES_OFFSET;
+}
+
+uint32_t* segment_content_start(void* segment) {
+    return segment + SEGMENT_CONTENT_START_OFFSET;
+}
+
+uint64_t* segment_min(void* segment) {
+    return segment + SEGMENT_MIN_OFFSET;
+}
+
+uint64_t* segment_max(void* segment) {
+    return segment + SEGMENT_MAX_OFFSET;
+}
+
+void* segment_values(void* segment) {
+    return segment + SEGMENT_HEADER_SIZE;
+}
+
+// Empty a segment so it holds rows from first_row on, keeping its place in the chain
+void segment_reset(void* segment, uint32_t first_row) {
+    *segment_first_row(segment) = first_row;
+    *segment_num_values(segment) = 0;
+    *segment_content_start(segment) = PAGE_SIZE;
+    *segment_min(segment) = UINT64_MAX;
+    *segment_max(segment) = 0;
+}
+
+uint32_t column_store_new_segment(Pager* pager, uint32_t first_row) {
+    uint32_t page_num = get_unused_page_num(pager);
+    void* segment = get_page(pager, page_num);
+    memset(segment, 0, PAGE_SIZE);
+    segment_reset(segment, first_row);
+    return page_num;
+}
+
+// Ints and dictionary codes are fixed-width in a segment, other text is not
+bool segment_is_fixed_width(ColumnDef* column) {
+    return column->type != COLUMN_TYPE_TEXT;
+}
+
+// Append one value. Returns false when the segment is full.
+bool segment_append(void* segment, ColumnDef* column, Value* value) {
+    uint32_t num_values = *segment_num_values(segment);
+
+    if (segment_is_fixed_width(column)) {
+        uint32_t width = column_row_size(column);
+        if (SEGMENT_HEADER_SIZE + (num_values + 1) * width > PAGE_SIZE) {
+            return false;
+        }
+        encode_native_int(value->integer, width, segment_values(segment) + num_values * width);
+        if (value->integer < *segment_min(segment)) {
+            *segment_min(segment) = value->integer;
+        }
+        if (value->integer > *segment_max(segment)) {
+            *segment_max(segment) = value->integer;
+        }
+    } else {
+        uint32_t length = strlen(value->text) + 1;
+        uint32_t content_start = *segment_content_start(segment);
+        if (SEGMENT_HEADER_SIZE + (num_values + 1) * sizeof(uint16_t) + length > content_start) {
+            return false;
+        }
+        content_start -= length;
+        memcpy(segment + content_start, value->text, length);
+        ((uint16_t*)segment_values(segment))[num_values] = content_start;
+        *segment_content_start(segment) = content_start;
+    }
+
+    *segment_num_values(segment) = num_values + 1;
+    return true;
+}
+
+// Append a value of the given row number to the column's last segment, moving on to the next one when full
+void column_store_append(Table* table, void* directory, Column column, Value* value, uint32_t row) {
+    ColumnDef* definition = &table->schema.columns[column];
+    uint32_t* last_segment = column_store_last_segment_field(directory, column);
+    void* segment = get_page(table->pager, *last_segment);
+    if (segment_append(segment, definition, value)) {
+        return;
+    }
+
+    // A rebuild reuses the pages already chained after the last segment
+    uint32_t next = *segment_next(segment);
+    if (next == 0) {
+        next = column_store_new_segment(table->pager, row);
+        *segment_next(segment) = next;
+    }
+    segment = get_page(table->pager, next);
+    segment_reset(segment, row);
+    *last_segment = next;
+    segment_append(segment, definition, value);
+}
+
+void column_store_create(Table* table) {
+    table->column_store_page_num = get_unused_page_num(table->pager);
+    void* directory = column_store_directory(table);
+    memset(directory, 0, PAGE_SIZE);
+
+    for (Column column = 0; column < table->schema.num_columns; column++) {
+        uint32_t page_num = column_store_new_segment(table->pager, 0);
+        *column_store_first_segment_field(directory, column) = page_num;
+        *column_store_last_segment_field(directory, column) = page_num;
+    }
+    column_store_refresh(table);
+}
+
+/*
+    Bring the replica up to date with the row store. Rows inserted past
+    its last key are appended from a scan starting right after that key.
+    A row inserted anywhere before it marks the replica stale, and a stale
+    replica is rebuilt from the first row, reusing its segment pages.
+*/
+void column_store_refresh(Table* table) {
+    Schema* schema = &table->schema;
+    void* directory = column_store_directory(table);
+    uint32_t* num_rows = column_store_num_rows_field(directory);
+    Cursor* cursor;
+
+    if (*column_store_stale(directory) || *num_rows == 0) {
+        *num_rows = 0;
+        *column_store_stale(directory) = false;
+        for (Column column = 0; column < schema->num_columns; column++) {
+            uint32_t first_segment = *column_store_first_segment_field(directory, column);
+            segment_reset(get_page(table->pager, first_segment), 0);
+            *column_store_last_segment_field(directory, column) = first_segment;
+        }
+        cursor = table_start(table);
+    } else {
+        uint8_t successor[TABLE_MAX_KEY_SIZE];
+        memcpy(successor, column_store_last_key(directory), schema->key_size);
+        if (!key_increment(successor, schema->key_size)) {
+            return;
+        }
+        cursor = table_find(table, successor);
+        cursor->end_of_table = false;
+        if (cursor->cell_num >= *leaf_node_num_cells(cursor_leaf(cursor))) {
+            cursor_next_leaf(cursor);
+        }
+    }
+
+    Row row;
+    while (!cursor->end_of_table) {
+        deserialize_row(schema, cursor_value(cursor), &row);
+        for (Column column = 0; column < schema->num_columns; column++) {
+            column_store_append(table, directory, column, &row.values[column], *num_rows);
+        }
+        key_encode(schema, &row, column_store_last_key(directory));
+        *num_rows += 1;
+        cursor_advance(cursor);
+    }
+    cursor_close(cursor);
+}
+
+// A row landing before the replica's last key cannot be appended later
+void column_store_note_insert(Table* table, void* key) {
+    void* directory = column_store_directory(table);
+    if (*column_store_num_rows_field(directory) > 0 &&
+        memcmp(key, column_store_last_key(directory), table->schema.key_size) < 0) {
+        *column_store_stale(directory) = true;
+    }
+}
+
+/*
+    Decode count values of a column, starting at the given row, into
+    values. The caller keeps one segment page per column in *page_num;
+    rows are read in increasing order, so it only ever moves forward.
+*/
+void column_store_read(Table* table, Column column, uint32_t* page_num, uint32_t row, uint32_t count,
+                       BatchValue* values) {
+    ColumnDef* definition = &table->schema.columns[column];
+    Dictionary* dictionary = table->dictionaries[column];
+
+    while (count > 0) {
+        void* segment = get_page(table->pager, *page_num);
+        uint32_t first_row = *segment_first_row(segment);
+        uint32_t num_values = *segment_num_values(segment);
+        if (row >= first_row + num_values) {
+            *page_num = *segment_next(segment);
+            continue;
+        }
+
+        uint32_t index = row - first_row;
+        uint32_t run = num_values - index < count ? num_values - index : count;
+        if (column_is_integer(definition)) {
+            uint32_t width = definition->size;
+            uint8_t* value = segment_values(segment) + index * width;
+            for (uint32_t i = 0; i < run; i++) {
+                values[i].integer = decode_native_int(value, width);
+                value += width;
+            }
+        } else if (dictionary != NULL) {
+            uint8_t* code = segment_values(segment) + index * COLUMN_DICT_CODE_SIZE;
+            for (uint32_t i = 0; i < run; i++) {
+                values[i].text = dictionary->values[decode_native_int(code, COLUMN_DICT_CODE_SIZE)];
+                code += COLUMN_DICT_CODE_SIZE;
+            }
+        } else {
+            uint16_t* offsets = (uint16_t*)segment_values(segment) + index;
+            for (uint32_t i = 0; i < run; i++) {
+                values[i].text = segment + offsets[i];
+            }
+        }
+
+        values += run;
+        row += run;
+        count -= run;
+    }
+}
+
+/*
+    Compute an aggregate from the replica. Count is the row count, min and
+    max only read the zone maps in the segment headers, and sum is one
+    tight loop per segment. Returns false if the table is empty.
+*/
+bool column_store_aggregate(Table* table, Aggregate aggregate, Column column, uint64_t* result) {
+    column_store_refresh(table);
+    uint32_t num_rows = column_store_num_rows(table);
+    if (aggregate == AGGREGATE_COUNT) {
+        *result = num_rows;
+        return true;
+    }
+    if (num_rows == 0) {
+        return false;
+    }
+
+    uint32_t width = table->schema.columns[column].size;
+    uint32_t page_num = column_store_first_segment(table, column);
+    uint32_t last_page_num = column_store_last_segment(table, column);
+    *result = (aggregate == AGGREGATE_MIN) ? UINT64_MAX : 0;
+    while (true) {
+        void* segment = get_page(table->pager, page_num);
+        switch (aggregate) {
+            case AGGREGATE_MIN:
+                if (*segment_min(segment) < *result) {
+                    *result = *segment_min(segment);
+                }
+                break;
+            case AGGREGATE_MAX:
+                if (*segment_max(segment) > *result) {
+                    *result = *segment_max(segment);
+                }
+                break;
+            case AGGREGATE_SUM: {
+                uint8_t* value = segment_values(segment);
+                uint32_t num_values = *segment_num_values(segment);
+                for (uint32_t i = 0; i < num_values; i++) {
+                    *result += decode_native_int(value, width);
+                    value += width;
+                }
+                break;
+            }
+            case AGGREGATE_COUNT:
+                break;
+        }
+        if (page_num == last_page_num) {
+            return true;
+        }
+        page_num = *segment_next(segment);
+    }
+}
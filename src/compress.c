@@ -0,0 +1,171 @@
+#include "../include/db.h"
+
+/*
+    LZ4-style page codec. A compressed page is a run of sequences, each a
+    token byte (literal count in the high nibble, match length minus
+    PAGE_CODEC_MIN_MATCH in the low nibble), the literals, and a 2-byte
+    little-endian offset back to the match. A nibble of 15 continues in
+    extra bytes that are added up until one is below 255. The last
+    sequence has literals only. Padded text columns and repeated email
+    domains turn into short matches.
+*/
+
+#define PAGE_CODEC_MIN_MATCH 4
+#define PAGE_CODEC_HASH_BITS 12
+
+uint32_t page_codec_hash(const uint8_t* source) {
+    uint32_t sequence;
+    memcpy(&sequence, source, sizeof(sequence));
+    return (sequence * 2654435761u) >> (32 - PAGE_CODEC_HASH_BITS);
+}
+
+// Append the part of a length that does not fit its nibble
+bool page_codec_put_length(uint8_t* destination, uint32_t* position, uint32_t capacity, uint32_t length) {
+    for (; length >= 255; length -= 255) {
+        if (*position >= capacity) {
+            return false;
+        }
+        destination[(*position)++] = 255;
+    }
+    if (*position >= capacity) {
+        return false;
+    }
+    destination[(*position)++] = length;
+    return true;
+}
+
+bool page_codec_get_length(const uint8_t* source, uint32_t* position, uint32_t size, uint32_t* length) {
+    uint8_t byte;
+    do {
+        if (*position >= size) {
+            return false;
+        }
+        byte = source[(*position)++];
+        *length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+bool page_codec_put_sequence(uint8_t* destination, uint32_t* position, uint32_t capacity, const uint8_t* literals,
+                             uint32_t num_literals, uint32_t offset, uint32_t match_length) {
+    if (*position >= capacity) {
+        return false;
+    }
+    uint32_t extra_match = match_length - PAGE_CODEC_MIN_MATCH;
+    uint8_t* token = destination + (*position)++;
+    *token = (num_literals < 15 ? num_literals : 15) << 4;
+    if (match_length > 0) {
+        *token |= extra_match < 15 ? extra_match : 15;
+    }
+
+    if (num_literals >= 15 && !page_codec_put_length(destination, position, capacity, num_literals - 15)) {
+        return false;
+    }
+    if (*position + num_literals > capacity) {
+        return false;
+    }
+    memcpy(destination + *position, literals, num_literals);
+    *position += num_literals;
+
+    if (match_length == 0) {
+        return true;
+    }
+    if (*position + 2 > capacity) {
+        return false;
+    }
+    destination[(*position)++] = offset & 0xff;
+    destination[(*position)++] = offset >> 8;
+    if (extra_match >= 15 && !page_codec_put_length(destination, position, capacity, extra_match - 15)) {
+        return false;
+    }
+    return true;
+}
+
+/*
+    Compress size bytes into at most capacity bytes. Returns the compressed
+    size, or 0 if the result would not fit, in which case the caller keeps
+    the page raw.
+*/
+uint32_t page_compress(const uint8_t* source, uint32_t size, uint8_t* destination, uint32_t capacity) {
+    // Positions are stored plus one so that zero means an empty slot
+    uint32_t table[1 << PAGE_CODEC_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    uint32_t position = 0;
+    uint32_t anchor = 0;
+    uint32_t input = 0;
+    while (input + PAGE_CODEC_MIN_MATCH <= size) {
+        uint32_t hash = page_codec_hash(source + input);
+        uint32_t candidate = table[hash];
+        table[hash] = input + 1;
+
+        if (candidate == 0 || input - (candidate - 1) > 0xffff ||
+            memcmp(source + candidate - 1, source + input, PAGE_CODEC_MIN_MATCH) != 0) {
+            input++;
+            continue;
+        }
+
+        // Matches may overlap the bytes they produce, so runs compress too
+        uint32_t match = candidate - 1;
+        uint32_t length = PAGE_CODEC_MIN_MATCH;
+        while (input + length < size && source[match + length] == source[input + length]) {
+            length++;
+        }
+
+        if (!page_codec_put_sequence(destination, &position, capacity, source + anchor, input - anchor,
+                                     input - match, length)) {
+            return 0;
+        }
+        input += length;
+        anchor = input;
+    }
+
+    if (!page_codec_put_sequence(destination, &position, capacity, source + anchor, size - anchor, 0, 0)) {
+        return 0;
+    }
+    return position;
+}
+
+// Decompress exactly capacity bytes. Returns false on malformed input.
+bool page_decompress(const uint8_t* source, uint32_t size, uint8_t* destination, uint32_t capacity) {
+    uint32_t input = 0;
+    uint32_t position = 0;
+
+    while (input < size) {
+        uint8_t token = source[input++];
+
+        uint32_t num_literals = token >> 4;
+        if (num_literals == 15 && !page_codec_get_length(source, &input, size, &num_literals)) {
+            return false;
+        }
+        if (input + num_literals > size || position + num_literals > capacity) {
+            return false;
+        }
+        memcpy(destination + position, source + input, num_literals);
+        input += num_literals;
+        position += num_literals;
+
+        if (input == size) {
+            break;
+        }
+
+        if (input + 2 > size) {
+            return false;
+        }
+        uint32_t offset = source[input] | (source[input + 1] << 8);
+        input += 2;
+        uint32_t length = token & 0xf;
+        if (length == 15 && !page_codec_get_length(source, &input, size, &length)) {
+            return false;
+        }
+        length += PAGE_CODEC_MIN_MATCH;
+        if (offset == 0 || offset > position || position + length > capacity) {
+            return false;
+        }
+        for (uint32_t i = 0; i < length; i++, position++) {
+            destination[position] = destination[position - offset];
+        }
+    }
+
+    return position == capacity;
+}
@@ -1,51 +1,142 @@
 #include "../include/db.h"
 
-// Define constants that are used for row sizes, offsets, and page sizes
-const uint32_t ID_SIZE = size_of_attribute(Row, id);
-const uint32_t USERNAME_SIZE = size_of_attribute(Row, username);
-const uint32_t EMAIL_SIZE = size_of_attribute(Row, email);
-const uint32_t ID_OFFSET = 0;
-const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
-const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
-const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
+// Define constants that are used for column sizes and page sizes
+const uint32_t COLUMN_INT_SIZE = sizeof(uint32_t);
+const uint32_t COLUMN_BIGINT_SIZE = sizeof(uint64_t);
+const uint32_t COLUMN_DICT_CODE_SIZE = sizeof(uint32_t);
 
 const uint32_t PAGE_SIZE = 4096;
 
+// Write-ahead log frame layout: a header, then the page image
+const uint32_t WAL_FRAME_PAGE_NUM_OFFSET = 0;
+const uint32_t WAL_FRAME_COMMIT_OFFSET = sizeof(uint32_t); // nonzero on the last frame of a commit
+const uint32_t WAL_FRAME_LSN_OFFSET = 2 * sizeof(uint32_t);
+const uint32_t WAL_FRAME_HEADER_SIZE = 2 * sizeof(uint32_t) + sizeof(uint64_t);
+const uint32_t WAL_FRAME_SIZE = 2 * sizeof(uint32_t) + sizeof(uint64_t) + 4096;
+
+// .pragma synchronous values, by Synchronous
+const char* const SYNCHRONOUS_NAMES[] = {"off", "normal", "full"};
+
 // Common Node Header Layout
 const uint32_t NODE_TYPE_SIZE = sizeof(uint8_t);
 const uint32_t NODE_TYPE_OFFSET = 0;
 const uint32_t IS_ROOT_SIZE = sizeof(uint8_t);
 const uint32_t IS_ROOT_OFFSET = NODE_TYPE_SIZE;
-const uint32_t PARENT_POINTER_SIZE = sizeof(uint32_t);
-const uint32_t PARENT_POINTER_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
-const uint32_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + PARENT_POINTER_SIZE;
+const uint32_t RIGHT_LINK_SIZE = sizeof(uint32_t); // right sibling on the same level, 0 for the rightmost node
+const uint32_t RIGHT_LINK_OFFSET = IS_ROOT_OFFSET + IS_ROOT_SIZE;
+const uint32_t COMMON_NODE_HEADER_SIZE = NODE_TYPE_SIZE + IS_ROOT_SIZE + RIGHT_LINK_SIZE;
 
 // Leaf Node Header Layout
 const uint32_t LEAF_NODE_NUM_CELLS_SIZE = sizeof(uint32_t);
 const uint32_t LEAF_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
-const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE;
+const uint32_t LEAF_NODE_BLOOM_SIZE = 32; // 256-bit bloom filter over the leaf's keys
+const uint32_t LEAF_NODE_BLOOM_OFFSET = LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE;
+const uint32_t LEAF_NODE_KEY_SIZE_SIZE = sizeof(uint8_t); // normalized key size of the owning table
+const uint32_t LEAF_NODE_KEY_SIZE_OFFSET = LEAF_NODE_BLOOM_OFFSET + LEAF_NODE_BLOOM_SIZE;
+const uint32_t LEAF_NODE_PREFIX_SIZE_SIZE = sizeof(uint8_t); // key bytes shared by every cell
+const uint32_t LEAF_NODE_PREFIX_SIZE_OFFSET = LEAF_NODE_KEY_SIZE_OFFSET + LEAF_NODE_KEY_SIZE_SIZE;
+const uint32_t LEAF_NODE_VALUE_SIZE_SIZE = sizeof(uint16_t); // row size of the owning table
+const uint32_t LEAF_NODE_VALUE_SIZE_OFFSET = LEAF_NODE_PREFIX_SIZE_OFFSET + LEAF_NODE_PREFIX_SIZE_SIZE;
+const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_BLOOM_SIZE +
+                                       LEAF_NODE_KEY_SIZE_SIZE + LEAF_NODE_PREFIX_SIZE_SIZE + LEAF_NODE_VALUE_SIZE_SIZE;
 
 // Leaf Node Body Layout
-const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
+// The high key, then the shared key prefix, then cells of the rest of the normalized key followed by the serialized row
 const uint32_t LEAF_NODE_KEY_OFFSET = 0;
-const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
-const uint32_t LEAF_NODE_VALUE_OFFSET = LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
-const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
 const uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-const uint32_t LEAF_NODE_MAX_CELLS = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
-
-// Leaf Node Split Constants
-const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
 
 // Internal Node Header Layout
+// The header is followed by the min and max fence keys and the high key, each of the node's key size
 const uint32_t INTERNAL_NODE_NUM_KEYS_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_NUM_KEYS_OFFSET = COMMON_NODE_HEADER_SIZE;
 const uint32_t INTERNAL_NODE_RIGHT_CHILD_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_RIGHT_CHILD_OFFSET = INTERNAL_NODE_NUM_KEYS_OFFSET + INTERNAL_NODE_NUM_KEYS_SIZE;
-const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+const uint32_t INTERNAL_NODE_KEY_SIZE_SIZE = sizeof(uint32_t);
+const uint32_t INTERNAL_NODE_KEY_SIZE_OFFSET = INTERNAL_NODE_RIGHT_CHILD_OFFSET + INTERNAL_NODE_RIGHT_CHILD_SIZE;
+const uint32_t INTERNAL_NODE_LEVEL_SIZE = sizeof(uint32_t); // height above the leaves, which are level 0
+const uint32_t INTERNAL_NODE_LEVEL_OFFSET = INTERNAL_NODE_KEY_SIZE_OFFSET + INTERNAL_NODE_KEY_SIZE_SIZE;
+const uint32_t INTERNAL_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE + INTERNAL_NODE_NUM_KEYS_SIZE + INTERNAL_NODE_RIGHT_CHILD_SIZE +
+                                           INTERNAL_NODE_KEY_SIZE_SIZE + INTERNAL_NODE_LEVEL_SIZE;
 
 // Internal Node Body Layout
-const uint32_t INTERNAL_NODE_KEY_SIZE = sizeof(uint32_t);
+// Cells are a child pointer followed by a key of the node's key size
 const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
-const uint32_t INTERNAL_NODE_CELL_SIZE = INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
+
+// Index Node Header Layout
+const uint32_t INDEX_NODE_NUM_CELLS_SIZE = sizeof(uint16_t);
+const uint32_t INDEX_NODE_NUM_CELLS_OFFSET = COMMON_NODE_HEADER_SIZE;
+const uint32_t INDEX_NODE_CONTENT_START_SIZE = sizeof(uint16_t);
+const uint32_t INDEX_NODE_CONTENT_START_OFFSET = INDEX_NODE_NUM_CELLS_OFFSET + INDEX_NODE_NUM_CELLS_SIZE;
+const uint32_t INDEX_NODE_RIGHT_POINTER_SIZE = sizeof(uint32_t); // right child, or next leaf
+const uint32_t INDEX_NODE_RIGHT_POINTER_OFFSET = INDEX_NODE_CONTENT_START_OFFSET + INDEX_NODE_CONTENT_START_SIZE;
+const uint32_t INDEX_NODE_HEADER_SIZE = INDEX_NODE_RIGHT_POINTER_OFFSET + INDEX_NODE_RIGHT_POINTER_SIZE;
+
+// Index Node Body Layout
+// Slots (cell offsets) grow up from the header, cell contents grow down from the page end
+const uint32_t INDEX_NODE_SLOT_SIZE = sizeof(uint16_t);
+const uint32_t INDEX_LEAF_CELL_HEADER_SIZE = sizeof(uint16_t) + sizeof(uint16_t); // key size, value size
+const uint32_t INDEX_INTERNAL_CELL_HEADER_SIZE = sizeof(uint32_t) + sizeof(uint16_t); // child, key size
+const uint32_t INDEX_MAX_CELL_SIZE = (PAGE_SIZE - INDEX_NODE_HEADER_SIZE) / 4 - INDEX_NODE_SLOT_SIZE;
+
+// Hash Index Directory Layout
+const uint32_t HASH_DIRECTORY_GLOBAL_DEPTH_OFFSET = 0;
+const uint32_t HASH_DIRECTORY_KEY_SIZE_OFFSET = sizeof(uint32_t);
+const uint32_t HASH_DIRECTORY_HEADER_SIZE = 2 * sizeof(uint32_t);
+const uint32_t HASH_DIRECTORY_SLOT_SIZE = sizeof(uint32_t);
+const uint32_t HASH_DIRECTORY_MAX_DEPTH = 9; // 512 slots fit in one page
+
+// Hash Index Bucket Layout
+const uint32_t HASH_BUCKET_LOCAL_DEPTH_OFFSET = 0;
+const uint32_t HASH_BUCKET_NUM_ENTRIES_OFFSET = sizeof(uint32_t);
+const uint32_t HASH_BUCKET_KEY_SIZE_OFFSET = 2 * sizeof(uint32_t); // normalized key size of each entry
+const uint32_t HASH_BUCKET_VALUE_SIZE_OFFSET = 3 * sizeof(uint32_t); // row size stored next to each key
+const uint32_t HASH_BUCKET_HEADER_SIZE = 4 * sizeof(uint32_t);
+
+// Column Store Directory Layout
+// The replica holds num_rows rows, the last of them with key last_key, and
+// each column is a chain of segment pages from its first to its last segment
+const uint32_t COLUMN_STORE_NUM_ROWS_OFFSET = 0;
+const uint32_t COLUMN_STORE_STALE_OFFSET = COLUMN_STORE_NUM_ROWS_OFFSET + sizeof(uint32_t);
+const uint32_t COLUMN_STORE_LAST_KEY_OFFSET = COLUMN_STORE_STALE_OFFSET + sizeof(uint32_t);
+const uint32_t COLUMN_STORE_SEGMENTS_OFFSET = COLUMN_STORE_LAST_KEY_OFFSET + TABLE_MAX_KEY_SIZE;
+const uint32_t COLUMN_STORE_SEGMENT_ENTRY_SIZE = 2 * sizeof(uint32_t); // first and last segment page
+
+// Column Segment Layout
+// Fixed-width values follow the header; text segments instead hold 2-byte
+// string offsets there, with the strings packed down from the end of the page
+const uint32_t SEGMENT_NEXT_OFFSET = 0;
+const uint32_t SEGMENT_FIRST_ROW_OFFSET = SEGMENT_NEXT_OFFSET + sizeof(uint32_t);
+const uint32_t SEGMENT_NUM_VALUES_OFFSET = SEGMENT_FIRST_ROW_OFFSET + sizeof(uint32_t);
+const uint32_t SEGMENT_CONTENT_START_OFFSET = SEGMENT_NUM_VALUES_OFFSET + sizeof(uint32_t);
+const uint32_t SEGMENT_MIN_OFFSET = SEGMENT_CONTENT_START_OFFSET + sizeof(uint32_t); // zone map
+const uint32_t SEGMENT_MAX_OFFSET = SEGMENT_MIN_OFFSET + sizeof(uint64_t);
+const uint32_t SEGMENT_HEADER_SIZE = SEGMENT_MAX_OFFSET + sizeof(uint64_t);
+
+// Page Map Layout (start of a compressed file)
+// Each entry is the file offset and stored size of a page; a stored size of
+// PAGE_SIZE means the page did not shrink and is kept raw
+const uint32_t PAGE_MAP_MAGIC = 0x5A515353; // "SSQZ"
+const uint32_t PAGE_MAP_MAGIC_OFFSET = 0;
+const uint32_t PAGE_MAP_NUM_PAGES_OFFSET = PAGE_MAP_MAGIC_OFFSET + sizeof(uint32_t);
+const uint32_t PAGE_MAP_ENTRIES_OFFSET = PAGE_MAP_NUM_PAGES_OFFSET + sizeof(uint32_t);
+const uint32_t PAGE_MAP_ENTRY_SIZE = 2 * sizeof(uint32_t);
+const uint32_t PAGE_MAP_SIZE = PAGE_MAP_ENTRIES_OFFSET + TABLE_MAX_PAGES * PAGE_MAP_ENTRY_SIZE;
+
+// Database Header Layout (page 0)
+const uint32_t DB_HEADER_MAGIC = 0x4C515353; // "SSQL"
+const uint32_t DB_HEADER_MAGIC_OFFSET = 0;
+const uint32_t DB_HEADER_CATALOG_ROOT_OFFSET = DB_HEADER_MAGIC_OFFSET + sizeof(uint32_t);
+
+// Catalog Entry Layout
+// The catalog is an index B-tree keyed by table name; every entry has the same size
+// so that adding an index rewrites it in place
+const uint32_t CATALOG_ROOT_PAGE_OFFSET = 0;
+const uint32_t CATALOG_NUM_COLUMNS_OFFSET = CATALOG_ROOT_PAGE_OFFSET + sizeof(uint32_t);
+const uint32_t CATALOG_COLUMNS_OFFSET = CATALOG_NUM_COLUMNS_OFFSET + sizeof(uint32_t);
+const uint32_t CATALOG_COLUMN_SIZE = COLUMN_NAME_MAX_SIZE + 1 + 3 * sizeof(uint32_t); // name, type, size, dictionary root
+const uint32_t CATALOG_NUM_INDEXES_OFFSET = CATALOG_COLUMNS_OFFSET + TABLE_MAX_COLUMNS * CATALOG_COLUMN_SIZE;
+const uint32_t CATALOG_INDEXES_OFFSET = CATALOG_NUM_INDEXES_OFFSET + sizeof(uint32_t);
+const uint32_t CATALOG_INDEX_ENTRY_SIZE = 4 * sizeof(uint32_t); // type, column, include mask, root page
+const uint32_t CATALOG_NUM_KEY_COLUMNS_OFFSET = CATALOG_INDEXES_OFFSET + TABLE_MAX_INDEXES * CATALOG_INDEX_ENTRY_SIZE;
+const uint32_t CATALOG_COLUMN_STORE_OFFSET = CATALOG_NUM_KEY_COLUMNS_OFFSET + sizeof(uint32_t);
+const uint32_t CATALOG_ENTRY_SIZE = CATALOG_COLUMN_STORE_OFFSET + sizeof(uint32_t);
@@ -0,0 +1,142 @@
+#include "../include/db.h"
+
+/*
+    Dictionary encoding for text columns declared "dict". Each distinct
+    value of the column gets a code, handed out in insertion order, and
+    rows store the code in place of the padded string. The dictionary
+    persists as an index B-tree keyed by the NUL-terminated value whose
+    payload is the code, and is loaded into an array indexed by code when
+    the table is opened. Strings in the array are interned, so two values
+    of the column are equal exactly when their pointers are.
+*/
+
+Dictionary* dictionary_new(uint32_t root_page_num) {
+    Dictionary* dictionary = malloc(sizeof(Dictionary));
+    dictionary->root_page_num = root_page_num;
+    dictionary->num_values = 0;
+    dictionary->capacity = 0;
+    dictionary->values = NULL;
+    return dictionary;
+}
+
+void dictionary_free(Dictionary* dictionary) {
+    for (uint32_t code = 0; code < dictionary->num_values; code++) {
+        free(dictionary->values[code]);
+    }
+    free(dictionary->values);
+    free(dictionary);
+}
+
+void dictionary_append(Dictionary* dictionary, uint32_t code, const char* value) {
+    if (code >= dictionary->capacity) {
+        dictionary->capacity = (code + 1) * 2;
+        dictionary->values = realloc(dictionary->values, dictionary->capacity * sizeof(char*));
+    }
+    for (uint32_t i = dictionary->num_values; i < code; i++) {
+        dictionary->values[i] = NULL;
+    }
+    dictionary->values[code] = strdup(value);
+    if (code >= dictionary->num_values) {
+        dictionary->num_values = code + 1;
+    }
+}
+
+// Read every (value, code) pair of the dictionary tree into the code array
+void dictionary_load(Pager* pager, Dictionary* dictionary) {
+    IndexCursor* cursor = index_seek(pager, dictionary->root_page_num, "", 0);
+    while (!cursor->end_of_index) {
+        uint32_t key_size, value_size;
+        char* value = index_cursor_key(cursor, &key_size);
+        uint32_t code = decode_native_int(index_cursor_value(cursor, &value_size), COLUMN_DICT_CODE_SIZE);
+        dictionary_append(dictionary, code, value);
+        index_cursor_advance(cursor);
+    }
+    free(cursor);
+}
+
+// Look up the code of a value. Returns false if the column never held it.
+bool dictionary_find(Pager* pager, Dictionary* dictionary, const char* value, uint32_t* code) {
+    uint32_t key_size = strlen(value) + 1;
+    IndexCursor* cursor = index_seek(pager, dictionary->root_page_num, (void*)value, key_size);
+    bool found = false;
+    if (!cursor->end_of_index) {
+        uint32_t cell_key_size, value_size;
+        void* key = index_cursor_key(cursor, &cell_key_size);
+        if (cell_key_size == key_size && memcmp(key, value, key_size) == 0) {
+            *code = decode_native_int(index_cursor_value(cursor, &value_size), COLUMN_DICT_CODE_SIZE);
+            found = true;
+        }
+    }
+    free(cursor);
+    return found;
+}
+
+// Return the code of a value, giving it the next free code if it is new
+uint32_t dictionary_intern(Pager* pager, Dictionary* dictionary, const char* value) {
+    uint32_t code;
+    if (dictionary_find(pager, dictionary, value, &code)) {
+        return code;
+    }
+
+    code = dictionary->num_values;
+    uint8_t payload[COLUMN_DICT_CODE_SIZE];
+    encode_native_int(code, COLUMN_DICT_CODE_SIZE, payload);
+    index_insert(pager, dictionary->root_page_num, (void*)value, strlen(value) + 1, payload, COLUMN_DICT_CODE_SIZE);
+    dictionary_append(dictionary, code, value);
+    return code;
+}
+
+// Give every dictionary column of a new table an empty dictionary tree
+void table_create_dictionaries(Table* table) {
+    for (Column column = 0; column < table->schema.num_columns; column++) {
+        table->dictionaries[column] = NULL;
+        if (table->schema.columns[column].type != COLUMN_TYPE_DICT_TEXT) {
+            continue;
+        }
+        uint32_t root_page_num = get_unused_page_num(table->pager);
+        void* root = get_page(table->pager, root_page_num);
+        initialize_index_leaf_node(root);
+        set_node_root(root, true);
+        table->dictionaries[column] = dictionary_new(root_page_num);
+    }
+}
+
+void table_free_dictionaries(Table* table) {
+    for (Column column = 0; column < table->schema.num_columns; column++) {
+        if (table->dictionaries[column] != NULL) {
+            dictionary_free(table->dictionaries[column]);
+        }
+    }
+}
+
+// Reread every dictionary from its tree, after a rollback put back the tree's pages
+void table_reload_dictionaries(Table* table) {
+    for (Column column = 0; column < table->schema.num_columns; column++) {
+        Dictionary* dictionary = table->dictionaries[column];
+        if (dictionary != NULL) {
+            table->dictionaries[column] = dictionary_new(dictionary->root_page_num);
+            dictionary_free(dictionary);
+            dictionary_load(table->pager, table->dictionaries[column]);
+        }
+    }
+}
+
+// Replace the text of every dictionary column by its code, ready to serialize
+void table_encode_dictionaries(Table* table, Row* row) {
+    for (Column column = 0; column < table->schema.num_columns; column++) {
+        Dictionary* dictionary = table->dictionaries[column];
+        if (dictionary != NULL) {
+            row->values[column].integer = dictionary_intern(table->pager, dictionary, row->values[column].text);
+        }
+    }
+}
+
+// Fill in the text of every dictionary column of a deserialized row
+void table_decode_dictionaries(Table* table, Row* row) {
+    for (Column column = 0; column < table->schema.num_columns; column++) {
+        Dictionary* dictionary = table->dictionaries[column];
+        if (dictionary != NULL) {
+            strcpy(row->values[column].text, dictionary->values[row->values[column].integer]);
+        }
+    }
+}
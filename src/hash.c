@@ -0,0 +1,182 @@
+#include "../include/db.h"
+
+/*
+    Extendible hash index over the table key. The directory page maps the
+    low global_depth bits of the hashed key to bucket pages; buckets hold
+    the normalized key next to a serialized copy of the row, so a point lookup reads the
+    directory and one bucket and never touches the B-tree.
+*/
+
+uint32_t* hash_directory_global_depth(void* directory) {
+    return directory + HASH_DIRECTORY_GLOBAL_DEPTH_OFFSET;
+}
+
+// Key size of the index, needed to hash a key before its bucket is known
+uint32_t* hash_directory_key_size(void* directory) {
+    return directory + HASH_DIRECTORY_KEY_SIZE_OFFSET;
+}
+
+uint32_t* hash_directory_bucket(void* directory, uint32_t slot) {
+    return directory + HASH_DIRECTORY_HEADER_SIZE + slot * HASH_DIRECTORY_SLOT_SIZE;
+}
+
+uint32_t* hash_bucket_local_depth(void* bucket) {
+    return bucket + HASH_BUCKET_LOCAL_DEPTH_OFFSET;
+}
+
+uint32_t* hash_bucket_num_entries(void* bucket) {
+    return bucket + HASH_BUCKET_NUM_ENTRIES_OFFSET;
+}
+
+uint32_t* hash_bucket_key_size(void* bucket) {
+    return bucket + HASH_BUCKET_KEY_SIZE_OFFSET;
+}
+
+uint32_t* hash_bucket_value_size(void* bucket) {
+    return bucket + HASH_BUCKET_VALUE_SIZE_OFFSET;
+}
+
+uint32_t hash_bucket_entry_size(void* bucket) {
+    return *hash_bucket_key_size(bucket) + *hash_bucket_value_size(bucket);
+}
+
+uint32_t hash_bucket_max_entries(void* bucket) {
+    return (PAGE_SIZE - HASH_BUCKET_HEADER_SIZE) / hash_bucket_entry_size(bucket);
+}
+
+void* hash_bucket_entry(void* bucket, uint32_t entry_num) {
+    return bucket + HASH_BUCKET_HEADER_SIZE + entry_num * hash_bucket_entry_size(bucket);
+}
+
+// Mix the key so sequential ids spread over every directory bit
+uint32_t hash_key(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+    return key;
+}
+
+// FNV-1a over the bytes of a normalized key, finished with the same mix
+uint32_t hash_bytes(void* key, uint32_t size) {
+    uint8_t* bytes = key;
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash_key(hash);
+}
+
+void initialize_hash_bucket(void* bucket, uint32_t local_depth, uint32_t key_size, uint32_t value_size) {
+    *hash_bucket_local_depth(bucket) = local_depth;
+    *hash_bucket_num_entries(bucket) = 0;
+    *hash_bucket_key_size(bucket) = key_size;
+    *hash_bucket_value_size(bucket) = value_size;
+}
+
+// key_size and value_size are the normalized key size and serialized row size of the indexed table
+void hash_index_initialize(Pager* pager, uint32_t directory_page_num, uint32_t key_size, uint32_t value_size) {
+    void* directory = get_page(pager, directory_page_num);
+    uint32_t bucket_page_num = get_unused_page_num(pager);
+    initialize_hash_bucket(get_page(pager, bucket_page_num), 0, key_size, value_size);
+
+    *hash_directory_global_depth(directory) = 0;
+    *hash_directory_key_size(directory) = key_size;
+    *hash_directory_bucket(directory, 0) = bucket_page_num;
+}
+
+uint32_t hash_index_bucket_page_num(Pager* pager, uint32_t directory_page_num, uint32_t hash) {
+    void* directory = get_page(pager, directory_page_num);
+    uint32_t mask = (1u << *hash_directory_global_depth(directory)) - 1;
+    return *hash_directory_bucket(directory, hash & mask);
+}
+
+// Return the serialized row stored for the normalized key, or NULL if there is none
+void* hash_index_find(Pager* pager, uint32_t directory_page_num, void* key) {
+    uint32_t key_size = *hash_directory_key_size(get_page(pager, directory_page_num));
+    void* bucket = get_page(pager, hash_index_bucket_page_num(pager, directory_page_num, hash_bytes(key, key_size)));
+    uint32_t num_entries = *hash_bucket_num_entries(bucket);
+
+    for (uint32_t i = 0; i < num_entries; i++) {
+        void* entry = hash_bucket_entry(bucket, i);
+        if (memcmp(entry, key, key_size) == 0) {
+            return entry + key_size;
+        }
+    }
+    return NULL;
+}
+
+/*
+    Split a full bucket on its next hash bit, doubling the directory first
+    when the bucket is already distinguished by every directory bit.
+*/
+void hash_index_split_bucket(Pager* pager, uint32_t directory_page_num, uint32_t bucket_page_num) {
+    void* directory = get_page(pager, directory_page_num);
+    void* bucket = get_page(pager, bucket_page_num);
+    uint32_t global_depth = *hash_directory_global_depth(directory);
+    uint32_t local_depth = *hash_bucket_local_depth(bucket);
+
+    if (local_depth == global_depth) {
+        if (global_depth == HASH_DIRECTORY_MAX_DEPTH) {
+            printf("Hash index full.\n");
+            exit(EXIT_FAILURE);
+        }
+        uint32_t num_slots = 1u << global_depth;
+        for (uint32_t i = 0; i < num_slots; i++) {
+            *hash_directory_bucket(directory, num_slots + i) = *hash_directory_bucket(directory, i);
+        }
+        *hash_directory_global_depth(directory) = ++global_depth;
+    }
+
+    uint32_t new_page_num = get_unused_page_num(pager);
+    void* new_bucket = get_page(pager, new_page_num);
+    uint32_t key_size = *hash_bucket_key_size(bucket);
+    initialize_hash_bucket(new_bucket, local_depth + 1, key_size, *hash_bucket_value_size(bucket));
+    *hash_bucket_local_depth(bucket) = local_depth + 1;
+
+    // Entries whose next hash bit is set move to the new bucket
+    uint32_t entry_size = hash_bucket_entry_size(bucket);
+    uint32_t split_bit = 1u << local_depth;
+    uint32_t num_entries = *hash_bucket_num_entries(bucket);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < num_entries; i++) {
+        void* entry = hash_bucket_entry(bucket, i);
+        if (hash_bytes(entry, key_size) & split_bit) {
+            uint32_t moved = (*hash_bucket_num_entries(new_bucket))++;
+            memcpy(hash_bucket_entry(new_bucket, moved), entry, entry_size);
+        } else {
+            memmove(hash_bucket_entry(bucket, kept), entry, entry_size);
+            kept++;
+        }
+    }
+    *hash_bucket_num_entries(bucket) = kept;
+
+    uint32_t num_slots = 1u << global_depth;
+    for (uint32_t i = 0; i < num_slots; i++) {
+        if (*hash_directory_bucket(directory, i) == bucket_page_num && (i & split_bit)) {
+            *hash_directory_bucket(directory, i) = new_page_num;
+        }
+    }
+}
+
+// Store the normalized key next to its serialized row
+void hash_index_insert(Pager* pager, uint32_t directory_page_num, void* key, void* value) {
+    uint32_t key_size = *hash_directory_key_size(get_page(pager, directory_page_num));
+    uint32_t hash = hash_bytes(key, key_size);
+    while (true) {
+        uint32_t bucket_page_num = hash_index_bucket_page_num(pager, directory_page_num, hash);
+        void* bucket = get_page(pager, bucket_page_num);
+        uint32_t num_entries = *hash_bucket_num_entries(bucket);
+
+        if (num_entries < hash_bucket_max_entries(bucket)) {
+            void* entry = hash_bucket_entry(bucket, num_entries);
+            memcpy(entry, key, key_size);
+            memcpy(entry + key_size, value, *hash_bucket_value_size(bucket));
+            *hash_bucket_num_entries(bucket) = num_entries + 1;
+            return;
+        }
+
+        hash_index_split_bucket(pager, directory_page_num, bucket_page_num);
+    }
+}
@@ -0,0 +1,416 @@
+#include "../include/db.h"
+
+uint16_t* index_node_num_cells(void* node) {
+    return node + INDEX_NODE_NUM_CELLS_OFFSET;
+}
+
+uint16_t* index_node_content_start(void* node) {
+    return node + INDEX_NODE_CONTENT_START_OFFSET;
+}
+
+// Right child of an internal node, or the next leaf of a leaf node (0 if none)
+uint32_t* index_node_right_pointer(void* node) {
+    return node + INDEX_NODE_RIGHT_POINTER_OFFSET;
+}
+
+uint16_t* index_node_slot(void* node, uint32_t cell_num) {
+    return node + INDEX_NODE_HEADER_SIZE + cell_num * INDEX_NODE_SLOT_SIZE;
+}
+
+void* index_node_cell(void* node, uint32_t cell_num) {
+    return node + *index_node_slot(node, cell_num);
+}
+
+uint32_t index_node_free_space(void* node) {
+    uint32_t slots_end = INDEX_NODE_HEADER_SIZE + *index_node_num_cells(node) * INDEX_NODE_SLOT_SIZE;
+    return *index_node_content_start(node) - slots_end;
+}
+
+/*
+    Leaf cell:     key size (u16) | value size (u16) | key | value
+    Internal cell: child (u32) | key size (u16) | key
+    Keys in an internal cell are >= every key in that child's subtree.
+*/
+void* index_cell_key(void* node, void* cell, uint32_t* key_size) {
+    if (get_node_type(node) == NODE_LEAF) {
+        *key_size = *(uint16_t*)cell;
+        return cell + INDEX_LEAF_CELL_HEADER_SIZE;
+    }
+    *key_size = *(uint16_t*)(cell + sizeof(uint32_t));
+    return cell + INDEX_INTERNAL_CELL_HEADER_SIZE;
+}
+
+uint32_t index_cell_size(void* node, void* cell) {
+    if (get_node_type(node) == NODE_LEAF) {
+        return INDEX_LEAF_CELL_HEADER_SIZE + *(uint16_t*)cell + *(uint16_t*)(cell + sizeof(uint16_t));
+    }
+    return INDEX_INTERNAL_CELL_HEADER_SIZE + *(uint16_t*)(cell + sizeof(uint32_t));
+}
+
+uint32_t* index_node_child(void* node, uint32_t child_num) {
+    if (child_num == *index_node_num_cells(node)) {
+        return index_node_right_pointer(node);
+    }
+    return index_node_cell(node, child_num);
+}
+
+void initialize_index_node(void* node, NodeType type) {
+    set_node_type(node, type);
+    set_node_root(node, false);
+    *index_node_num_cells(node) = 0;
+    *index_node_content_start(node) = PAGE_SIZE;
+    *index_node_right_pointer(node) = 0;
+}
+
+void initialize_index_leaf_node(void* node) {
+    initialize_index_node(node, NODE_LEAF);
+}
+
+void initialize_index_internal_node(void* node) {
+    initialize_index_node(node, NODE_INTERNAL);
+}
+
+int index_key_compare(void* a, uint32_t a_size, void* b, uint32_t b_size) {
+    int result = memcmp(a, b, a_size < b_size ? a_size : b_size);
+    if (result != 0) {
+        return result;
+    }
+    return (a_size > b_size) - (a_size < b_size);
+}
+
+/*
+    Encode (column value, table key) so that a plain memcmp orders entries
+    by value and then key: a text value is NUL-terminated (strings never
+    contain NUL), an int value is stored big-endian and the table key in
+    its normalized form.
+*/
+uint32_t index_key_encode(Schema* schema, Column column, Row* row, uint8_t* destination) {
+    uint32_t length;
+    if (column_is_integer(&schema->columns[column])) {
+        length = schema->columns[column].size;
+        encode_big_endian(row->values[column].integer, length, destination);
+    } else {
+        length = strlen(row->values[column].text) + 1;
+        memcpy(destination, row->values[column].text, length);
+    }
+
+    key_encode(schema, row, destination + length);
+    return length + schema->key_size;
+}
+
+// The normalized table key closing an index key
+void* index_key_table_key(Schema* schema, void* key, uint32_t key_size) {
+    return key + key_size - schema->key_size;
+}
+
+/*
+    Included columns are stored in the leaf payload in column order, text
+    as NUL-terminated strings and ints in native order, so they can be
+    read in place.
+*/
+uint32_t index_payload_encode(Schema* schema, uint32_t include_mask, Row* row, uint8_t* destination) {
+    uint32_t size = 0;
+    for (Column column = 0; column < schema->num_columns; column++) {
+        if (!(include_mask & COLUMN_MASK(column))) {
+            continue;
+        }
+        if (column_is_integer(&schema->columns[column])) {
+            encode_native_int(row->values[column].integer, schema->columns[column].size, destination + size);
+            size += schema->columns[column].size;
+        } else {
+            uint32_t length = strlen(row->values[column].text) + 1;
+            memcpy(destination + size, row->values[column].text, length);
+            size += length;
+        }
+    }
+    return size;
+}
+
+// Index of the first cell whose key is >= the given key
+uint32_t index_node_find_cell(void* node, void* key, uint32_t key_size) {
+    uint32_t min_index = 0;
+    uint32_t one_past_max_index = *index_node_num_cells(node);
+    while (one_past_max_index != min_index) {
+        uint32_t index = (min_index + one_past_max_index) / 2;
+        uint32_t cell_key_size;
+        void* cell_key = index_cell_key(node, index_node_cell(node, index), &cell_key_size);
+        if (index_key_compare(cell_key, cell_key_size, key, key_size) >= 0) {
+            one_past_max_index = index;
+        } else {
+            min_index = index + 1;
+        }
+    }
+    return min_index;
+}
+
+// Descend to the leaf that should hold the key, remembering the path taken
+uint32_t index_find_leaf(Pager* pager, uint32_t root_page_num, void* key, uint32_t key_size, IndexPath* path) {
+    uint32_t page_num = root_page_num;
+    void* node = get_page(pager, page_num);
+    path->depth = 0;
+
+    while (get_node_type(node) == NODE_INTERNAL) {
+        if (path->depth >= INDEX_MAX_DEPTH - 1) {
+            printf("Index tree is too deep.\n");
+            exit(EXIT_FAILURE);
+        }
+        uint32_t child_num = index_node_find_cell(node, key, key_size);
+        path->page_nums[path->depth] = page_num;
+        path->child_nums[path->depth] = child_num;
+        path->depth += 1;
+
+        page_num = *index_node_child(node, child_num);
+        node = get_page(pager, page_num);
+    }
+
+    path->page_nums[path->depth] = page_num;
+    path->depth += 1;
+    return page_num;
+}
+
+// Place a cell at position cell_num, assuming the node has room for it
+void index_node_put_cell(void* node, uint32_t cell_num, void* cell, uint32_t cell_size) {
+    uint32_t num_cells = *index_node_num_cells(node);
+    uint16_t offset = *index_node_content_start(node) - cell_size;
+    memcpy(node + offset, cell, cell_size);
+
+    memmove(index_node_slot(node, cell_num + 1), index_node_slot(node, cell_num),
+            (num_cells - cell_num) * INDEX_NODE_SLOT_SIZE);
+    *index_node_slot(node, cell_num) = offset;
+    *index_node_content_start(node) = offset;
+    *index_node_num_cells(node) = num_cells + 1;
+}
+
+/*
+    Move the root's contents to a fresh page and turn the root into an
+    internal node whose only child is that page. The root page number
+    never changes, so it can be stored once in the database header.
+*/
+void index_grow_root(Pager* pager, IndexPath* path) {
+    uint32_t root_page_num = path->page_nums[0];
+    void* root = get_page(pager, root_page_num);
+    uint32_t child_page_num = get_unused_page_num(pager);
+    void* child = get_page(pager, child_page_num);
+
+    memcpy(child, root, PAGE_SIZE);
+    set_node_root(child, false);
+
+    initialize_index_internal_node(root);
+    set_node_root(root, true);
+    *index_node_right_pointer(root) = child_page_num;
+
+    memmove(&path->page_nums[1], &path->page_nums[0], path->depth * sizeof(uint32_t));
+    memmove(&path->child_nums[1], &path->child_nums[0], path->depth * sizeof(uint32_t));
+    path->page_nums[0] = root_page_num;
+    path->page_nums[1] = child_page_num;
+    path->child_nums[0] = 0;
+    path->depth += 1;
+}
+
+void index_insert_into_node(Pager* pager, IndexPath* path, uint32_t level, uint32_t cell_num,
+                            void* cell, uint32_t cell_size, uint32_t right_page_num);
+
+/*
+    Split a full node while inserting a cell into it. The lower half stays
+    in place, the upper half moves to a new page, and a separator pointing
+    at the lower half is inserted into the parent.
+*/
+void index_node_split_and_insert(Pager* pager, IndexPath* path, uint32_t level, uint32_t cell_num,
+                                 void* cell, uint32_t cell_size, uint32_t right_page_num) {
+    if (level == 0) {
+        index_grow_root(pager, path);
+        level = 1;
+    }
+
+    uint32_t page_num = path->page_nums[level];
+    void* node = get_page(pager, page_num);
+    bool is_leaf = get_node_type(node) == NODE_LEAF;
+
+    // Lay out every cell, including the new one, in a scratch copy
+    uint8_t old_node[PAGE_SIZE];
+    memcpy(old_node, node, PAGE_SIZE);
+    uint32_t num_cells = *index_node_num_cells(old_node) + 1;
+    void* cells[num_cells];
+    uint32_t sizes[num_cells];
+    uint32_t total_size = 0;
+    uint8_t new_cell[cell_size];
+    memcpy(new_cell, cell, cell_size);
+
+    for (uint32_t i = 0, j = 0; i < num_cells; i++) {
+        if (i == cell_num) {
+            cells[i] = new_cell;
+            sizes[i] = cell_size;
+        } else {
+            cells[i] = index_node_cell(old_node, j);
+            sizes[i] = index_cell_size(old_node, cells[i]);
+            j++;
+        }
+        total_size += sizes[i] + INDEX_NODE_SLOT_SIZE;
+    }
+
+    uint32_t right_pointer = *index_node_right_pointer(old_node);
+    if (!is_leaf) {
+        // The child pointer that followed the split child now points at its new right half
+        if (cell_num + 1 < num_cells) {
+            *(uint32_t*)cells[cell_num + 1] = right_page_num;
+        } else {
+            right_pointer = right_page_num;
+        }
+    }
+
+    // Split where the lower half first holds at least half of the bytes
+    uint32_t split = 0;
+    uint32_t left_size = 0;
+    while (split < num_cells - 1 && left_size + sizes[split] + INDEX_NODE_SLOT_SIZE <= total_size / 2) {
+        left_size += sizes[split] + INDEX_NODE_SLOT_SIZE;
+        split++;
+    }
+    if (split == 0) {
+        split = 1;
+    }
+
+    uint32_t new_page_num = get_unused_page_num(pager);
+    void* new_node = get_page(pager, new_page_num);
+    initialize_index_node(new_node, get_node_type(old_node));
+    initialize_index_node(node, get_node_type(old_node));
+
+    uint32_t separator_size;
+    void* separator;
+    if (is_leaf) {
+        // Leaves keep every cell; the separator only has to fall between the halves
+        for (uint32_t i = 0; i < split; i++) {
+            index_node_put_cell(node, i, cells[i], sizes[i]);
+        }
+        for (uint32_t i = split; i < num_cells; i++) {
+            index_node_put_cell(new_node, i - split, cells[i], sizes[i]);
+        }
+        *index_node_right_pointer(new_node) = right_pointer;
+        *index_node_right_pointer(node) = new_page_num;
+
+        // Suffix truncation: the shortest prefix of the upper half's min key
+        // that sorts above the lower half's max key separates them as well
+        uint32_t lower_size, upper_size;
+        uint8_t* lower = index_cell_key(node, cells[split - 1], &lower_size);
+        uint8_t* upper = index_cell_key(node, cells[split], &upper_size);
+        uint32_t length = common_prefix_size(lower, upper, lower_size < upper_size ? lower_size : upper_size) + 1;
+        if (length < upper_size) {
+            separator = upper;
+            separator_size = length;
+        } else {
+            separator = lower;
+            separator_size = lower_size;
+        }
+    } else {
+        // The middle cell moves up; its child becomes the lower half's right child
+        for (uint32_t i = 0; i < split; i++) {
+            index_node_put_cell(node, i, cells[i], sizes[i]);
+        }
+        for (uint32_t i = split + 1; i < num_cells; i++) {
+            index_node_put_cell(new_node, i - split - 1, cells[i], sizes[i]);
+        }
+        *index_node_right_pointer(node) = *(uint32_t*)cells[split];
+        *index_node_right_pointer(new_node) = right_pointer;
+        separator = index_cell_key(node, cells[split], &separator_size);
+    }
+
+    uint32_t parent_cell_size = INDEX_INTERNAL_CELL_HEADER_SIZE + separator_size;
+    uint8_t parent_cell[parent_cell_size];
+    *(uint32_t*)parent_cell = page_num;
+    *(uint16_t*)(parent_cell + sizeof(uint32_t)) = separator_size;
+    memcpy(parent_cell + INDEX_INTERNAL_CELL_HEADER_SIZE, separator, separator_size);
+
+    index_insert_into_node(pager, path, level - 1, path->child_nums[level - 1],
+                           parent_cell, parent_cell_size, new_page_num);
+}
+
+/*
+    Insert a cell at position cell_num of the node at the given level of
+    the path. For internal nodes right_page_num is the page that takes
+    over the child pointer following the inserted cell.
+*/
+void index_insert_into_node(Pager* pager, IndexPath* path, uint32_t level, uint32_t cell_num,
+                            void* cell, uint32_t cell_size, uint32_t right_page_num) {
+    void* node = get_page(pager, path->page_nums[level]);
+
+    if (index_node_free_space(node) < cell_size + INDEX_NODE_SLOT_SIZE) {
+        index_node_split_and_insert(pager, path, level, cell_num, cell, cell_size, right_page_num);
+        return;
+    }
+
+    index_node_put_cell(node, cell_num, cell, cell_size);
+    if (get_node_type(node) == NODE_INTERNAL) {
+        *index_node_child(node, cell_num + 1) = right_page_num;
+    }
+}
+
+void index_insert(Pager* pager, uint32_t root_page_num, void* key, uint32_t key_size, void* value, uint32_t value_size) {
+    uint32_t cell_size = INDEX_LEAF_CELL_HEADER_SIZE + key_size + value_size;
+    if (cell_size > INDEX_MAX_CELL_SIZE) {
+        printf("Index entry too large.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t cell[cell_size];
+    *(uint16_t*)cell = key_size;
+    *(uint16_t*)(cell + sizeof(uint16_t)) = value_size;
+    memcpy(cell + INDEX_LEAF_CELL_HEADER_SIZE, key, key_size);
+    if (value_size > 0) {
+        memcpy(cell + INDEX_LEAF_CELL_HEADER_SIZE + key_size, value, value_size);
+    }
+
+    IndexPath path;
+    index_find_leaf(pager, root_page_num, key, key_size, &path);
+    void* leaf = get_page(pager, path.page_nums[path.depth - 1]);
+    uint32_t cell_num = index_node_find_cell(leaf, key, key_size);
+
+    index_insert_into_node(pager, &path, path.depth - 1, cell_num, cell, cell_size, 0);
+}
+
+// Skip forward over exhausted leaves
+void index_cursor_settle(IndexCursor* cursor) {
+    void* node = get_page(cursor->pager, cursor->page_num);
+    while (cursor->cell_num >= *index_node_num_cells(node)) {
+        uint32_t next_page_num = *index_node_right_pointer(node);
+        if (next_page_num == 0) {
+            cursor->end_of_index = true;
+            return;
+        }
+        cursor->page_num = next_page_num;
+        cursor->cell_num = 0;
+        node = get_page(cursor->pager, next_page_num);
+    }
+}
+
+// Position a cursor on the first entry whose key is >= the given key
+IndexCursor* index_seek(Pager* pager, uint32_t root_page_num, void* key, uint32_t key_size) {
+    IndexPath path;
+    uint32_t page_num = index_find_leaf(pager, root_page_num, key, key_size, &path);
+    void* node = get_page(pager, page_num);
+
+    IndexCursor* cursor = malloc(sizeof(IndexCursor));
+    cursor->pager = pager;
+    cursor->page_num = page_num;
+    cursor->cell_num = index_node_find_cell(node, key, key_size);
+    cursor->end_of_index = false;
+    index_cursor_settle(cursor);
+
+    return cursor;
+}
+
+void* index_cursor_key(IndexCursor* cursor, uint32_t* key_size) {
+    void* node = get_page(cursor->pager, cursor->page_num);
+    return index_cell_key(node, index_node_cell(node, cursor->cell_num), key_size);
+}
+
+void* index_cursor_value(IndexCursor* cursor, uint32_t* value_size) {
+    void* node = get_page(cursor->pager, cursor->page_num);
+    void* cell = index_node_cell(node, cursor->cell_num);
+    uint32_t key_size = *(uint16_t*)cell;
+    *value_size = *(uint16_t*)(cell + sizeof(uint16_t));
+    return cell + INDEX_LEAF_CELL_HEADER_SIZE + key_size;
+}
+
+void index_cursor_advance(IndexCursor* cursor) {
+    cursor->cell_num += 1;
+    index_cursor_settle(cursor);
+}
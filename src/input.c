@@ -9,8 +9,26 @@ InputBuffer* new_input_buffer() {
     return input_buffer;
 }
 
+// Statement output goes to the calling thread's session, or to stdout outside server mode
+__thread FILE* session_output = NULL;
+
+FILE* output_stream() {
+    return (session_output != NULL) ? session_output : stdout;
+}
+
+void set_output_stream(FILE* stream) {
+    session_output = stream;
+}
+
+// The session the calling thread runs statements for: a client in server mode, NULL for the REPL
+__thread void* current_session = NULL;
+
+void set_session(void* session) {
+    current_session = session;
+}
+
 void print_prompt() {
-    printf("db > ");
+    fprintf(output_stream(), "db > ");
 }
 
 void read_input(InputBuffer* input_buffer) {
@@ -31,105 +49,1382 @@ void close_input_buffer(InputBuffer* input_buffer) {
     free(input_buffer);
 }
 
-MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table) {
+MetaCommandResult do_meta_command(InputBuffer* input_buffer, Database* db) {
     if (strcmp(input_buffer->buffer, ".exit") == 0) {
         close_input_buffer(input_buffer);
-        db_close(table);
+        db_close(db);
         exit(EXIT_SUCCESS);
-    } else if (strcmp(input_buffer->buffer, ".btree") == 0) {
-        printf("Tree:\n");
-        print_tree(table->pager, 0, 0);
+    } else if (strcmp(input_buffer->buffer, ".btree") == 0 || strncmp(input_buffer->buffer, ".btree ", 7) == 0) {
+        // .btree prints the users table, .btree <table> any other
+        const char* table_name = DEFAULT_TABLE_NAME;
+        if (input_buffer->buffer[6] == ' ') {
+            table_name = input_buffer->buffer + 7;
+        }
+        Table* table = db_find_table(db, table_name);
+        if (table == NULL) {
+            return META_COMMAND_UNRECOGNIZED_COMMAND;
+        }
+        fprintf(output_stream(), "Tree:\n");
+        print_tree(table, table->root_page_num, 0);
         return META_COMMAND_SUCCESS;
     } else if (strcmp(input_buffer->buffer, ".constants") == 0) {
-        printf("Constants:\n");
-        print_constants();
+        fprintf(output_stream(), "Constants:\n");
+        print_constants(db_find_table(db, DEFAULT_TABLE_NAME));
+        return META_COMMAND_SUCCESS;
+    } else if (strcmp(input_buffer->buffer, ".compression on") == 0) {
+        // Takes effect when the file is written on close
+        pager_set_compress(db->pager, true);
+        return META_COMMAND_SUCCESS;
+    } else if (strcmp(input_buffer->buffer, ".compression off") == 0) {
+        pager_set_compress(db->pager, false);
         return META_COMMAND_SUCCESS;
+    } else if (strcmp(input_buffer->buffer, ".pragma synchronous") == 0) {
+        fprintf(output_stream(), "synchronous = %s\n", SYNCHRONOUS_NAMES[db->pager->synchronous]);
+        return META_COMMAND_SUCCESS;
+    } else if (strncmp(input_buffer->buffer, ".pragma synchronous = ", 22) == 0) {
+        // Trades durability for throughput from the next commit on
+        for (Synchronous synchronous = SYNCHRONOUS_OFF; synchronous <= SYNCHRONOUS_FULL; synchronous++) {
+            if (strcmp(input_buffer->buffer + 22, SYNCHRONOUS_NAMES[synchronous]) == 0) {
+                // The checkpointer reads it when it syncs the file
+                __atomic_store_n(&db->pager->synchronous, synchronous, __ATOMIC_RELAXED);
+                return META_COMMAND_SUCCESS;
+            }
+        }
+        return META_COMMAND_UNRECOGNIZED_COMMAND;
     } else {
         return META_COMMAND_UNRECOGNIZED_COMMAND;
     }
 }
 
-PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
+// Parse a decimal int (4 bytes) or bigint (8 bytes) value that fits the column's size
+bool parse_integer(const char* token, uint32_t size, uint64_t* value) {
+    if (token == NULL || !isdigit((unsigned char)token[0])) {
+        return false;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(token, &end, 10);
+    if (*end != '\0' || errno != 0 || (size == COLUMN_INT_SIZE && parsed > UINT32_MAX)) {
+        return false;
+    }
+
+    *value = parsed;
+    return true;
+}
+
+/*
+    insert <values...> adds a row to the users table,
+    insert into <table> <values...> to any other. Values are given in
+    schema order, separated by spaces.
+*/
+PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement, Database* db) {
     statement->type = STATEMENT_INSERT;
     char* keyword = strtok(input_buffer->buffer, " ");
-    char* id_string = strtok(NULL, " ");
-    char* username = strtok(NULL, " ");
-    char* email = strtok(NULL, " ");
+    char* token = strtok(NULL, " ");
+
+    const char* table_name = DEFAULT_TABLE_NAME;
+    if (token != NULL && strcmp(token, "into") == 0) {
+        table_name = strtok(NULL, " ");
+        if (table_name == NULL) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        token = strtok(NULL, " ");
+    }
+    statement->table = db_find_table(db, table_name);
+    if (statement->table == NULL) {
+        return PREPARE_UNRECOGNIZED_TABLE;
+    }
 
-    if (id_string == NULL || username == NULL || email == NULL) {
+    Schema* schema = &statement->table->schema;
+    char* values[TABLE_MAX_COLUMNS];
+    for (Column column = 0; column < schema->num_columns; column++) {
+        if (token == NULL) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        values[column] = token;
+        token = strtok(NULL, " ");
+    }
+    if (token != NULL) {
         return PREPARE_SYNTAX_ERROR;
     }
 
-    int id = atoi(id_string);
-    if (id < 0) {
-        return PREPARE_NEGATIVE_ID;
+    for (Column column = 0; column < schema->num_columns; column++) {
+        ColumnDef* definition = &schema->columns[column];
+        Value* value = &statement->row_to_insert.values[column];
+        if (column_is_integer(definition)) {
+            if (values[column][0] == '-' && column < schema->num_key_columns) {
+                return PREPARE_NEGATIVE_ID;
+            }
+            if (!parse_integer(values[column], definition->size, &value->integer)) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+        } else {
+            if (strlen(values[column]) > definition->size - 1) {
+                return PREPARE_STRING_TOO_LONG;
+            }
+            // Pad the slot so the row codec can copy it whole
+            strncpy(value->text, values[column], definition->size);
+        }
+    }
+
+    return PREPARE_SUCCESS;
+}
+
+bool parse_column(Schema* schema, const char* name, Column* column) {
+    int32_t position = schema_find_column(schema, name);
+    if (position < 0) {
+        return false;
+    }
+    *column = position;
+    return true;
+}
+
+// count(*), or min/max/sum over an int column
+bool parse_aggregate(Schema* schema, const char* token, Aggregate* aggregate, Column* column) {
+    if (strcmp(token, "count(*)") == 0) {
+        *aggregate = AGGREGATE_COUNT;
+        *column = KEY_COLUMN;
+        return true;
+    }
+
+    size_t length = strlen(token);
+    if (length < 6 || token[3] != '(' || token[length - 1] != ')' || length - 5 > COLUMN_NAME_MAX_SIZE) {
+        return false;
+    }
+    char name[COLUMN_NAME_MAX_SIZE + 1];
+    memcpy(name, token + 4, length - 5);
+    name[length - 5] = '\0';
+    if (!parse_column(schema, name, column) || !column_is_integer(&schema->columns[*column])) {
+        return false;
+    }
+
+    if (strncmp(token, "min", 3) == 0) {
+        *aggregate = AGGREGATE_MIN;
+    } else if (strncmp(token, "max", 3) == 0) {
+        *aggregate = AGGREGATE_MAX;
+    } else if (strncmp(token, "sum", 3) == 0) {
+        *aggregate = AGGREGATE_SUM;
+    } else {
+        return false;
     }
-    if (strlen(username) > COLUMN_USERNAME_SIZE) {
+    return true;
+}
+
+void add_select_column(Statement* statement, Column column) {
+    statement->columns[statement->num_columns++] = column;
+    statement->column_mask |= COLUMN_MASK(column);
+}
+
+bool is_select_clause(const char* token) {
+    return strcmp(token, "from") == 0 || strcmp(token, "where") == 0 || strcmp(token, "order") == 0 ||
+           strcmp(token, "limit") == 0 || strcmp(token, "offset") == 0;
+}
+
+bool parse_row_count(const char* token, uint32_t* value) {
+    if (token == NULL || !isdigit((unsigned char)token[0])) {
+        return false;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long parsed = strtoul(token, &end, 10);
+    if (*end != '\0' || errno != 0 || parsed > UINT32_MAX) {
+        return false;
+    }
+
+    *value = parsed;
+    return true;
+}
+
+// Parse "column = value" or "column like prefix%" following a where keyword
+PrepareResult prepare_where(Statement* statement, Schema* schema) {
+    char* column_name = strtok(NULL, " ,");
+    char* operator = strtok(NULL, " ,");
+    char* value = strtok(NULL, " ,");
+
+    if (column_name == NULL || operator == NULL || value == NULL) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    if (!parse_column(schema, column_name, &statement->where_column)) {
+        return PREPARE_UNRECOGNIZED_COLUMN;
+    }
+    statement->has_where = true;
+    statement->where_is_prefix = false;
+
+    ColumnDef* definition = &schema->columns[statement->where_column];
+    if (column_is_integer(definition)) {
+        if (strcmp(operator, "=") != 0 || !parse_integer(value, definition->size, &statement->where_integer)) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        return PREPARE_SUCCESS;
+    }
+
+    size_t length = strlen(value);
+    if (strcmp(operator, "like") == 0 && length > 0 && value[length - 1] == '%') {
+        statement->where_is_prefix = true;
+        length -= 1;
+    } else if (strcmp(operator, "=") != 0 && strcmp(operator, "like") != 0) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    if (length > definition->size - 1) {
         return PREPARE_STRING_TOO_LONG;
     }
-    if (strlen(email) > COLUMN_EMAIL_SIZE) {
+    memcpy(statement->where_value, value, length);
+    statement->where_value[length] = '\0';
+
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult prepare_select(InputBuffer* input_buffer, Statement* statement, Database* db) {
+    statement->type = STATEMENT_SELECT;
+    statement->num_columns = 0;
+    statement->column_mask = 0;
+    statement->num_aggregates = 0;
+    statement->has_order_by = false;
+    statement->has_limit = false;
+    statement->limit = 0;
+    statement->offset = 0;
+    statement->has_where = false;
+
+    char* keyword = strtok(input_buffer->buffer, " ");
+    char* token = strtok(NULL, " ,");
+
+    // The projection is resolved once the from clause names the table
+    char* items[MAX_SELECT_COLUMNS];
+    uint32_t num_items = 0;
+    while (token != NULL && !is_select_clause(token)) {
+        if (num_items >= MAX_SELECT_COLUMNS) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        items[num_items++] = token;
+        token = strtok(NULL, " ,");
+    }
+
+    const char* table_name = DEFAULT_TABLE_NAME;
+    if (token != NULL && strcmp(token, "from") == 0) {
+        table_name = strtok(NULL, " ,");
+        if (table_name == NULL) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        token = strtok(NULL, " ,");
+    }
+    statement->table = db_find_table(db, table_name);
+    if (statement->table == NULL) {
+        return PREPARE_UNRECOGNIZED_TABLE;
+    }
+    Schema* schema = &statement->table->schema;
+
+    uint32_t first_item = 0;
+    if (num_items == 0 || strcmp(items[0], "*") == 0) {
+        // Bare select returns every column
+        for (Column column = 0; column < schema->num_columns; column++) {
+            add_select_column(statement, column);
+        }
+        first_item = (num_items > 0) ? 1 : 0;
+    }
+
+    for (uint32_t i = first_item; i < num_items; i++) {
+        Column column;
+        Aggregate aggregate;
+        if (statement->num_columns + statement->num_aggregates >= MAX_SELECT_COLUMNS) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        if (parse_aggregate(schema, items[i], &aggregate, &column)) {
+            statement->aggregate_columns[statement->num_aggregates] = column;
+            statement->aggregates[statement->num_aggregates++] = aggregate;
+        } else if (parse_column(schema, items[i], &column)) {
+            add_select_column(statement, column);
+        } else if (strchr(items[i], '(') != NULL) {
+            return PREPARE_SYNTAX_ERROR;
+        } else {
+            return PREPARE_UNRECOGNIZED_COLUMN;
+        }
+    }
+
+    // Without grouping, plain columns cannot be mixed with aggregates
+    if (statement->num_columns > 0 && statement->num_aggregates > 0) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    while (token != NULL) {
+        if (strcmp(token, "where") == 0) {
+            if (statement->has_where) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+            PrepareResult result = prepare_where(statement, schema);
+            if (result != PREPARE_SUCCESS) {
+                return result;
+            }
+        } else if (strcmp(token, "order") == 0) {
+            token = strtok(NULL, " ,");
+            if (token == NULL || strcmp(token, "by") != 0) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+            token = strtok(NULL, " ,");
+            if (token == NULL) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+            if (!parse_column(schema, token, &statement->order_by)) {
+                return PREPARE_UNRECOGNIZED_COLUMN;
+            }
+            // Rows already come out of the tree in key order
+            statement->has_order_by = (statement->order_by != KEY_COLUMN);
+        } else if (strcmp(token, "limit") == 0) {
+            if (!parse_row_count(strtok(NULL, " ,"), &statement->limit)) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+            statement->has_limit = true;
+        } else if (strcmp(token, "offset") == 0) {
+            if (!parse_row_count(strtok(NULL, " ,"), &statement->offset)) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+        } else {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        token = strtok(NULL, " ,");
+    }
+
+    // Aggregates are computed over the whole table into a single row
+    if (statement->num_aggregates > 0 &&
+        (statement->has_where || statement->has_order_by || statement->has_limit || statement->offset > 0)) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    return PREPARE_SUCCESS;
+}
+
+PrepareResult prepare_create_index(InputBuffer* input_buffer, Statement* statement, Database* db) {
+    statement->type = STATEMENT_CREATE_INDEX;
+    statement->index_type = INDEX_BTREE;
+    statement->index_include_mask = 0;
+    char* keyword = strtok(input_buffer->buffer, " ");
+    char* object = strtok(NULL, " ");
+    if (object != NULL && strcmp(object, "hash") == 0) {
+        // create hash index on users(id), on a single-column key only
+        statement->index_type = INDEX_HASH;
+        object = strtok(NULL, " ");
+    }
+    char* on = strtok(NULL, " (");
+    char* table_name = strtok(NULL, " (");
+    char* column_name = strtok(NULL, " (),");
+    char* include = strtok(NULL, " (),");
+
+    if (object == NULL || strcmp(object, "index") != 0 || on == NULL || strcmp(on, "on") != 0 ||
+        table_name == NULL || column_name == NULL) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    statement->table = db_find_table(db, table_name);
+    if (statement->table == NULL) {
+        return PREPARE_UNRECOGNIZED_TABLE;
+    }
+    Schema* schema = &statement->table->schema;
+
+    if (include != NULL) {
+        // create index on users(email) include (username)
+        if (strcmp(include, "include") != 0) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        char* token = strtok(NULL, " (),");
+        if (token == NULL) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        while (token != NULL) {
+            Column column;
+            if (!parse_column(schema, token, &column)) {
+                return PREPARE_UNRECOGNIZED_COLUMN;
+            }
+            statement->index_include_mask |= COLUMN_MASK(column);
+            token = strtok(NULL, " (),");
+        }
+    }
+    if (!parse_column(schema, column_name, &statement->index_column)) {
+        return PREPARE_UNRECOGNIZED_COLUMN;
+    }
+    // Hash indexes serve point lookups on the key; the B-tree already orders by its leading column
+    if ((statement->index_type == INDEX_HASH) != (statement->index_column == KEY_COLUMN)) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    if (statement->index_type == INDEX_HASH && (statement->index_include_mask != 0 || schema->num_key_columns > 1)) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    // The index key itself already carries the indexed column and the table key
+    statement->index_include_mask &= ~(COLUMN_MASK(statement->index_column) | schema_key_mask(schema));
+
+    return PREPARE_SUCCESS;
+}
+
+/*
+    Parse "key (a, b)" following a primary keyword: the key columns must be
+    the leading int or bigint columns of the table, in order.
+*/
+PrepareResult prepare_primary_key(Statement* statement) {
+    Schema* schema = &statement->schema;
+    char* keyword = strtok(NULL, " (),");
+    if (keyword == NULL || strcmp(keyword, "key") != 0) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    uint32_t num_key_columns = 0;
+    char* column_name = strtok(NULL, " (),");
+    while (column_name != NULL) {
+        if (num_key_columns >= schema->num_columns ||
+            strcmp(schema->columns[num_key_columns].name, column_name) != 0) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        num_key_columns++;
+        column_name = strtok(NULL, " (),");
+    }
+    if (num_key_columns == 0) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+
+    schema_set_key_columns(schema, num_key_columns);
+    return PREPARE_SUCCESS;
+}
+
+/*
+    create table orders (id int, item text(32), quantity int) keys the table
+    on its first column; create table events (tenant int, id bigint, body
+    text(64), primary key (tenant, id)) on a composite key.
+*/
+PrepareResult prepare_create_table(InputBuffer* input_buffer, Statement* statement) {
+    statement->type = STATEMENT_CREATE_TABLE;
+    statement->schema.num_columns = 0;
+    statement->schema.row_size = 0;
+    char* keyword = strtok(input_buffer->buffer, " ");
+    char* object = strtok(NULL, " ");
+    char* table_name = strtok(NULL, " (");
+    char* column_name = strtok(NULL, " (),");
+
+    if (table_name == NULL || column_name == NULL) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    if (strlen(table_name) > TABLE_NAME_MAX_SIZE) {
         return PREPARE_STRING_TOO_LONG;
     }
+    strcpy(statement->table_name, table_name);
+
+    while (column_name != NULL) {
+        if (strcmp(column_name, "primary") == 0) {
+            PrepareResult result = prepare_primary_key(statement);
+            if (result != PREPARE_SUCCESS) {
+                return result;
+            }
+            break;
+        }
+
+        char* type = strtok(NULL, " (),");
+        if (type == NULL || statement->schema.num_columns >= TABLE_MAX_COLUMNS ||
+            schema_find_column(&statement->schema, column_name) >= 0) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        if (strlen(column_name) > COLUMN_NAME_MAX_SIZE) {
+            return PREPARE_STRING_TOO_LONG;
+        }
+
+        if (strcmp(type, "int") == 0) {
+            schema_add_column(&statement->schema, column_name, COLUMN_TYPE_INT, COLUMN_INT_SIZE);
+        } else if (strcmp(type, "bigint") == 0) {
+            schema_add_column(&statement->schema, column_name, COLUMN_TYPE_BIGINT, COLUMN_BIGINT_SIZE);
+        } else if (strcmp(type, "text") == 0) {
+            uint32_t length;
+            if (!parse_row_count(strtok(NULL, " (),"), &length) || length == 0 || length > COLUMN_TEXT_MAX_SIZE) {
+                return PREPARE_SYNTAX_ERROR;
+            }
+
+            // text(n) dict stores each value as a code into the column's dictionary
+            ColumnType text_type = COLUMN_TYPE_TEXT;
+            char* next = strtok(NULL, " (),");
+            if (next != NULL && strcmp(next, "dict") == 0) {
+                text_type = COLUMN_TYPE_DICT_TEXT;
+                next = strtok(NULL, " (),");
+            }
+            schema_add_column(&statement->schema, column_name, text_type, length + 1);
+            column_name = next;
+            continue;
+        } else {
+            return PREPARE_SYNTAX_ERROR;
+        }
+        column_name = strtok(NULL, " (),");
+    }
+
+    if (statement->schema.num_columns == 0) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    for (Column column = 0; column < statement->schema.num_key_columns; column++) {
+        if (!column_is_integer(&statement->schema.columns[column])) {
+            return PREPARE_SYNTAX_ERROR;
+        }
+    }
 
-    statement->row_to_insert.id = id;
-    strcpy(statement->row_to_insert.username, username);
-    strcpy(statement->row_to_insert.email, email);
+    return PREPARE_SUCCESS;
+}
+
+// create column store on <table>
+PrepareResult prepare_create_column_store(InputBuffer* input_buffer, Statement* statement, Database* db) {
+    statement->type = STATEMENT_CREATE_COLUMN_STORE;
+    char* keyword = strtok(input_buffer->buffer, " ");
+    char* column = strtok(NULL, " ");
+    char* store = strtok(NULL, " ");
+    char* on = strtok(NULL, " ");
+    char* table_name = strtok(NULL, " ");
 
+    if (on == NULL || strcmp(on, "on") != 0 || table_name == NULL || strtok(NULL, " ") != NULL) {
+        return PREPARE_SYNTAX_ERROR;
+    }
+    statement->table = db_find_table(db, table_name);
+    if (statement->table == NULL) {
+        return PREPARE_UNRECOGNIZED_TABLE;
+    }
     return PREPARE_SUCCESS;
 }
 
-PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement) {
+PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement, Database* db) {
+    statement->explain = false;
+    if (strncmp(input_buffer->buffer, "explain select", 14) == 0) {
+        // Drop the explain keyword and prepare the select that follows
+        memmove(input_buffer->buffer, input_buffer->buffer + 8, strlen(input_buffer->buffer + 8) + 1);
+        PrepareResult result = prepare_select(input_buffer, statement, db);
+        statement->explain = true;
+        return result;
+    }
     if (strncmp(input_buffer->buffer, "insert", 6) == 0) {
-        return prepare_insert(input_buffer, statement);
+        return prepare_insert(input_buffer, statement, db);
+    }
+    if (strcmp(input_buffer->buffer, "select") == 0 || strncmp(input_buffer->buffer, "select ", 7) == 0) {
+        return prepare_select(input_buffer, statement, db);
+    }
+    if (strncmp(input_buffer->buffer, "create table ", 13) == 0) {
+        return prepare_create_table(input_buffer, statement);
+    }
+    if (strncmp(input_buffer->buffer, "create column store ", 20) == 0) {
+        return prepare_create_column_store(input_buffer, statement, db);
+    }
+    if (strncmp(input_buffer->buffer, "create ", 7) == 0) {
+        return prepare_create_index(input_buffer, statement, db);
     }
-    if (strcmp(input_buffer->buffer, "select") == 0) {
-        statement->type = STATEMENT_SELECT;
+    if (strcmp(input_buffer->buffer, "begin") == 0) {
+        statement->type = STATEMENT_BEGIN;
+        return PREPARE_SUCCESS;
+    }
+    if (strcmp(input_buffer->buffer, "commit") == 0) {
+        statement->type = STATEMENT_COMMIT;
+        return PREPARE_SUCCESS;
+    }
+    if (strcmp(input_buffer->buffer, "rollback") == 0) {
+        statement->type = STATEMENT_ROLLBACK;
         return PREPARE_SUCCESS;
     }
 
     return PREPARE_UNRECOGNIZED_STATEMENT;
 }
 
-ExecuteResult execute_insert(Statement* statement, Table* table) {
-    void* node = get_page(table->pager, table->root_page_num);
-    uint32_t num_cells = (*leaf_node_num_cells(node));
+// Add a row to an index, given both decoded and serialized
+void index_insert_row(Table* table, Index* index, Row* row, void* value) {
+    if (index->type == INDEX_HASH) {
+        uint8_t key[TABLE_MAX_KEY_SIZE];
+        key_encode(&table->schema, row, key);
+        hash_index_insert(table->pager, index->root_page_num, key, value);
+        return;
+    }
 
+    uint8_t key[COLUMN_TEXT_MAX_SIZE + 1 + TABLE_MAX_KEY_SIZE];
+    uint8_t payload[TABLE_MAX_COLUMNS * (COLUMN_TEXT_MAX_SIZE + 1)];
+    uint32_t key_size = index_key_encode(&table->schema, index->column, row, key);
+    uint32_t payload_size = index_payload_encode(&table->schema, index->include_mask, row, payload);
+    index_insert(table->pager, index->root_page_num, key, key_size, payload, payload_size);
+}
+
+ExecuteResult execute_insert(Statement* statement) {
+    Table* table = statement->table;
     Row* row_to_insert = &(statement->row_to_insert);
-    uint32_t key_to_insert = row_to_insert->id;
-    Cursor* cursor = table_find(table, key_to_insert);
+    uint8_t key_to_insert[TABLE_MAX_KEY_SIZE];
+    key_encode(&table->schema, row_to_insert, key_to_insert);
+    if (!pager_reserve(table->pager, INSERT_MAX_NEW_PAGES)) {
+        return EXECUTE_TABLE_FULL;
+    }
+    bool maybe_present;
+    Cursor* cursor = table_find_for_insert(table, key_to_insert, &maybe_present);
 
-    if (cursor->cell_num < num_cells) {
-        uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
-        if (key_at_index == key_to_insert) {
+    void* node = get_page(table->pager, cursor->page_num);
+    uint32_t num_cells = (*leaf_node_num_cells(node));
+
+    if (maybe_present && cursor->cell_num < num_cells) {
+        if (leaf_node_key_compare(node, cursor->cell_num, key_to_insert) == 0) {
+            cursor_close(cursor);
+            pager_unreserve(table->pager, INSERT_MAX_NEW_PAGES);
             return EXECUTE_DUPLICATE_KEY;
         }
     }
 
-    leaf_node_insert(cursor, row_to_insert->id, row_to_insert);
+    uint8_t value[table->schema.row_size];
+    table_encode_dictionaries(table, row_to_insert);
+    serialize_row(&table->schema, row_to_insert, value);
+    // Snapshots opened from here on wait for the leaf's latch, so they see the row
+    table->pager->row_versions[cursor->page_num] =
+        version_store_stamp(&table->versions, key_to_insert, table->schema.key_size);
+    leaf_node_insert(cursor, key_to_insert, value);
+    cursor_close(cursor);
+
+    for (uint32_t i = 0; i < table->num_indexes; i++) {
+        index_insert_row(table, &table->indexes[i], row_to_insert, value);
+    }
+    if (table->column_store_page_num != 0) {
+        column_store_note_insert(table, key_to_insert);
+    }
+    pager_unreserve(table->pager, INSERT_MAX_NEW_PAGES);
 
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_select(Statement* statement, Table* table) {
+// An aggregate over an empty table is NULL, except for count
+void print_aggregate(Table* table, Aggregate aggregate, Column column) {
+    uint64_t result;
+    bool has_result;
+    if (table->column_store_page_num != 0) {
+        has_result = column_store_aggregate(table, aggregate, column, &result);
+    } else {
+        has_result = table_aggregate(table, aggregate, column, &result);
+    }
+
+    if (has_result) {
+        fprintf(output_stream(), "%llu", (unsigned long long)result);
+    } else {
+        fprintf(output_stream(), "NULL");
+    }
+}
+
+ExecuteResult execute_aggregate(Statement* statement) {
+    fprintf(output_stream(), "(");
+    for (uint32_t i = 0; i < statement->num_aggregates; i++) {
+        if (i > 0) {
+            fprintf(output_stream(), ", ");
+        }
+        print_aggregate(statement->table, statement->aggregates[i], statement->aggregate_columns[i]);
+    }
+    fprintf(output_stream(), ")\n");
+
+    return EXECUTE_SUCCESS;
+}
+
+// Point the batch at the columns of a serialized row
+void batch_append_row(RowBatch* batch, Table* table, void* value) {
+    Schema* schema = &table->schema;
+    uint32_t row = batch->num_rows;
+    for (Column column = 0; column < schema->num_columns; column++) {
+        void* slot = value + schema->offsets[column];
+        Dictionary* dictionary = table->dictionaries[column];
+        if (column_is_integer(&schema->columns[column])) {
+            batch->columns[column][row].integer = decode_native_int(slot, schema->columns[column].size);
+        } else if (dictionary != NULL) {
+            batch->columns[column][row].text = dictionary->values[decode_native_int(slot, COLUMN_DICT_CODE_SIZE)];
+        } else {
+            batch->columns[column][row].text = slot;
+        }
+    }
+    batch->num_rows += 1;
+}
+
+bool row_matches(Statement* statement, RowBatch* batch, uint32_t index) {
+    BatchValue* value = &batch->columns[statement->where_column][index];
+    if (column_is_integer(&statement->table->schema.columns[statement->where_column])) {
+        return value->integer == statement->where_integer;
+    }
+    if (statement->where_dictionary_value != NULL) {
+        // Dictionary strings are interned, so equal codes mean equal pointers
+        return value->text == statement->where_dictionary_value;
+    }
+    if (statement->where_is_prefix) {
+        return strncmp(value->text, statement->where_value, strlen(statement->where_value)) == 0;
+    }
+    return strcmp(value->text, statement->where_value) == 0;
+}
+
+// Drop rows failing the where predicate, compacting the batch in place
+void filter_batch(Statement* statement, RowBatch* batch) {
+    uint32_t num_columns = statement->table->schema.num_columns;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < batch->num_rows; i++) {
+        if (row_matches(statement, batch, i)) {
+            for (Column column = 0; column < num_columns; column++) {
+                batch->columns[column][kept] = batch->columns[column][i];
+            }
+            kept++;
+        }
+    }
+    batch->num_rows = kept;
+}
+
+// Hand a batch to the sink. Returns false once no more rows are wanted.
+bool row_sink_consume(RowSink* sink, RowBatch* batch) {
+    for (uint32_t i = 0; i < batch->num_rows; i++) {
+        if (sink->heap != NULL) {
+            top_k_offer(sink->heap, batch, i);
+            continue;
+        }
+        if (sink->remaining == 0) {
+            return false;
+        }
+        if (sink->to_skip > 0) {
+            sink->to_skip -= 1;
+            continue;
+        }
+        print_batch_row(batch, i, sink->statement);
+        sink->remaining -= 1;
+    }
+    return sink->heap != NULL || sink->remaining > 0;
+}
+
+// Columns a scan has to fill: the projection, the where column and the heap's sort columns
+uint32_t scan_column_mask(Statement* statement, Table* table, RowSink* sink) {
+    uint32_t column_mask = statement->column_mask;
+    if (sink->heap != NULL) {
+        column_mask |= COLUMN_MASK(statement->order_by) | schema_key_mask(&table->schema);
+    }
+    if (statement->has_where) {
+        column_mask |= COLUMN_MASK(statement->where_column);
+    }
+    return column_mask;
+}
+
+void scan_table(Statement* statement, Table* table, RowSink* sink, RowBatch* batch) {
+    uint32_t column_mask = scan_column_mask(statement, table, sink);
     Cursor* cursor = table_start(table);
 
+    // Unfiltered, the offset skips whole leaves and the limit bounds every batch
+    bool bounded = !statement->has_where && sink->heap == NULL;
+    if (bounded) {
+        cursor_skip(cursor, sink->to_skip);
+        sink->to_skip = 0;
+    }
+
+    while (true) {
+        uint32_t max_rows = bounded ? sink->remaining : UINT32_MAX;
+        if (max_rows == 0 || cursor_next_batch(cursor, batch, column_mask, max_rows) == 0) {
+            break;
+        }
+        if (statement->has_where) {
+            filter_batch(statement, batch);
+        }
+        if (!row_sink_consume(sink, batch)) {
+            break;
+        }
+    }
+
+    cursor_close(cursor);
+}
+
+/*
+    Full or filtered scan of the columnar replica, decoding only the
+    columns the query needs. The segments of the where column, or else of
+    the key column, drive the scan; an equality on an int column skips
+    every segment whose zone map excludes the value, and the other
+    columns are only read for the rows of segments that may match.
+*/
+void scan_column_store(Statement* statement, Table* table, RowSink* sink, RowBatch* batch) {
+    column_store_refresh(table);
+    Schema* schema = &table->schema;
+    uint32_t column_mask = scan_column_mask(statement, table, sink);
+    uint32_t page_nums[TABLE_MAX_COLUMNS];
+    for (Column column = 0; column < schema->num_columns; column++) {
+        page_nums[column] = column_store_first_segment(table, column);
+    }
+
+    Column driver = statement->has_where ? statement->where_column : KEY_COLUMN;
+    bool zone_filter = statement->has_where && column_is_integer(&schema->columns[driver]);
+    uint32_t page_num = column_store_first_segment(table, driver);
+    uint32_t last_page_num = column_store_last_segment(table, driver);
+    bool wanted = column_store_num_rows(table) > 0;
+
+    while (wanted) {
+        void* segment = get_page(table->pager, page_num);
+        uint32_t first_row = *segment_first_row(segment);
+        uint32_t num_values = *segment_num_values(segment);
+        bool may_match = !zone_filter || (statement->where_integer >= *segment_min(segment) &&
+                                          statement->where_integer <= *segment_max(segment));
+
+        for (uint32_t done = 0; may_match && wanted && done < num_values; done += batch->num_rows) {
+            batch->num_rows = num_values - done < SCAN_BATCH_SIZE ? num_values - done : SCAN_BATCH_SIZE;
+            for (Column column = 0; column < schema->num_columns; column++) {
+                if (column_mask & COLUMN_MASK(column)) {
+                    column_store_read(table, column, &page_nums[column], first_row + done, batch->num_rows,
+                                      batch->columns[column]);
+                }
+            }
+            uint32_t num_read = batch->num_rows;
+            if (statement->has_where) {
+                filter_batch(statement, batch);
+            }
+            wanted = row_sink_consume(sink, batch);
+            batch->num_rows = num_read;
+        }
+
+        if (page_num == last_page_num) {
+            break;
+        }
+        page_num = *segment_next(segment);
+    }
+}
+
+// where key = k is a single descent of the primary tree
+void lookup_id(Statement* statement, Table* table, RowSink* sink, RowBatch* batch) {
+    uint8_t key[TABLE_MAX_KEY_SIZE];
+    encode_big_endian(statement->where_integer, table->schema.key_size, key);
+    Cursor* cursor = table_find_existing(table, key);
+
+    batch->num_rows = 0;
+    if (cursor != NULL) {
+        batch_append_row(batch, table, cursor_value(cursor));
+    }
+    row_sink_consume(sink, batch);
+    if (cursor != NULL) {
+        cursor_close(cursor);
+    }
+}
+
+/*
+    where k = v on the leading column of a composite key: the matching rows
+    are one contiguous run of the tree, starting at the smallest key with
+    that leading value.
+*/
+void scan_key_prefix(Statement* statement, Table* table, RowSink* sink, RowBatch* batch) {
+    uint8_t key[TABLE_MAX_KEY_SIZE] = {0};
+    encode_big_endian(statement->where_integer, table->schema.columns[KEY_COLUMN].size, key);
+    uint32_t column_mask = scan_column_mask(statement, table, sink);
+
+    Cursor* cursor = table_find(table, key);
+    cursor->end_of_table = false;
+    if (cursor->cell_num >= *leaf_node_num_cells(cursor_leaf(cursor))) {
+        cursor_next_leaf(cursor);
+    }
+
+    bool in_range = true;
+    while (in_range && cursor_next_batch(cursor, batch, column_mask, SCAN_BATCH_SIZE) > 0) {
+        // Rows come out in key order, so the run ends at the first mismatch
+        for (uint32_t i = 0; i < batch->num_rows; i++) {
+            if (!row_matches(statement, batch, i)) {
+                batch->num_rows = i;
+                in_range = false;
+                break;
+            }
+        }
+        if (!row_sink_consume(sink, batch)) {
+            break;
+        }
+    }
+
+    cursor_close(cursor);
+}
+
+// where key = k through a hash index: the directory page and one bucket page
+void lookup_hash(Statement* statement, Table* table, Index* index, RowSink* sink, RowBatch* batch) {
+    uint8_t key[TABLE_MAX_KEY_SIZE];
+    encode_big_endian(statement->where_integer, table->schema.key_size, key);
+    void* row = hash_index_find(table->pager, index->root_page_num, key);
+
+    batch->num_rows = 0;
+    if (row != NULL) {
+        batch_append_row(batch, table, row);
+    }
+    row_sink_consume(sink, batch);
+}
+
+// Point the batch at the columns stored in an index entry: the key and the included payload
+void batch_append_index_entry(RowBatch* batch, Schema* schema, Index* index, void* key, uint32_t key_size, void* payload) {
+    uint32_t row = batch->num_rows;
+    void* table_key = index_key_table_key(schema, key, key_size);
+    for (Column column = 0; column < schema->num_key_columns; column++) {
+        batch->columns[column][row].integer = key_column_decode(schema, table_key, column);
+    }
+    if (column_is_integer(&schema->columns[index->column])) {
+        batch->columns[index->column][row].integer = decode_big_endian(key, schema->columns[index->column].size);
+    } else {
+        batch->columns[index->column][row].text = key;
+    }
+
+    for (Column column = 0; column < schema->num_columns; column++) {
+        if (!(index->include_mask & COLUMN_MASK(column))) {
+            continue;
+        }
+        if (column_is_integer(&schema->columns[column])) {
+            batch->columns[column][row].integer = decode_native_int(payload, schema->columns[column].size);
+            payload += schema->columns[column].size;
+        } else {
+            batch->columns[column][row].text = payload;
+            payload += strlen(payload) + 1;
+        }
+    }
+    batch->num_rows += 1;
+}
+
+/*
+    Equality or prefix lookup through a secondary index. Index keys are the
+    encoded column value followed by the table key, so every match sits in
+    one contiguous run starting at the first key >= the value. A covering index
+    answers from its own leaves; otherwise each match descends the table.
+*/
+void scan_index(Statement* statement, Table* table, Index* index, bool covering, RowSink* sink, RowBatch* batch) {
+    uint8_t prefix[COLUMN_TEXT_MAX_SIZE + 1];
+    uint32_t prefix_size;
+    if (column_is_integer(&table->schema.columns[index->column])) {
+        prefix_size = table->schema.columns[index->column].size;
+        encode_big_endian(statement->where_integer, prefix_size, prefix);
+    } else {
+        prefix_size = strlen(statement->where_value);
+        memcpy(prefix, statement->where_value, prefix_size + 1);
+        if (!statement->where_is_prefix) {
+            prefix_size += 1; // include the terminator, so "bob" does not match "bobby"
+        }
+    }
+
+    IndexCursor* cursor = index_seek(table->pager, index->root_page_num, prefix, prefix_size);
+    bool wanted = true;
+    batch->num_rows = 0;
+
+    while (wanted && !cursor->end_of_index) {
+        uint32_t key_size;
+        void* key = index_cursor_key(cursor, &key_size);
+        if (key_size < prefix_size || memcmp(key, prefix, prefix_size) != 0) {
+            break;
+        }
+
+        if (covering) {
+            uint32_t payload_size;
+            batch_append_index_entry(batch, &table->schema, index, key, key_size, index_cursor_value(cursor, &payload_size));
+        } else {
+            Cursor* row_cursor = table_find_existing(table, index_key_table_key(&table->schema, key, key_size));
+            if (row_cursor != NULL) {
+                batch_append_row(batch, table, cursor_value(row_cursor));
+                cursor_close(row_cursor);
+            }
+        }
+
+        if (batch->num_rows == SCAN_BATCH_SIZE) {
+            wanted = row_sink_consume(sink, batch);
+            batch->num_rows = 0;
+        }
+        index_cursor_advance(cursor);
+    }
+    if (wanted) {
+        row_sink_consume(sink, batch);
+    }
+
+    free(cursor);
+}
+
+/*
+    Equality on a dictionary column is decided on codes: the value is looked
+    up in the dictionary once, before the scan. Returns false when the
+    column never held the value, so no row can match.
+*/
+bool resolve_dictionary_where(Statement* statement, Table* table) {
+    statement->where_dictionary_value = NULL;
+    if (!statement->has_where || statement->where_is_prefix) {
+        return true;
+    }
+    Dictionary* dictionary = table->dictionaries[statement->where_column];
+    if (dictionary == NULL) {
+        return true;
+    }
+
+    uint32_t code;
+    if (!dictionary_find(table->pager, dictionary, statement->where_value, &code)) {
+        return false;
+    }
+    statement->where_dictionary_value = dictionary->values[code];
+    return true;
+}
+
+// Every row is visited, so a columnar replica beats the row store
+SelectPlan plan_full_scan(Table* table) {
+    return (table->column_store_page_num != 0) ? PLAN_COLUMN_STORE : PLAN_FULL_SCAN;
+}
+
+/*
+    Pick an access path for the where clause: a hash index or else the
+    primary key for the key column, a range of the primary key for the
+    leading column of a composite key, a secondary index when one exists
+    on the column, else a filtered scan, of the column store if the table
+    has one. A value missing from a dictionary
+    column needs no access path at all.
+    The index covers the query when every column it reads is in the index.
+*/
+SelectPlan plan_select(Statement* statement, Table* table, Index** index) {
+    *index = NULL;
+    if (!resolve_dictionary_where(statement, table)) {
+        return PLAN_NO_MATCH;
+    }
+    if (!statement->has_where) {
+        return plan_full_scan(table);
+    }
+    if (statement->where_column == KEY_COLUMN && table->schema.num_key_columns > 1) {
+        return PLAN_PRIMARY_KEY_PREFIX;
+    }
+    if (statement->where_column == KEY_COLUMN) {
+        *index = table_index_on(table, KEY_COLUMN, INDEX_HASH);
+        return (*index != NULL) ? PLAN_HASH_INDEX : PLAN_PRIMARY_KEY;
+    }
+
+    *index = table_index_on(table, statement->where_column, INDEX_BTREE);
+    if (*index == NULL) {
+        return plan_full_scan(table);
+    }
+
+    uint32_t needed = statement->column_mask | schema_key_mask(&table->schema);
+    if (statement->has_order_by) {
+        needed |= COLUMN_MASK(statement->order_by);
+    }
+    uint32_t stored = COLUMN_MASK((*index)->column) | schema_key_mask(&table->schema) | (*index)->include_mask;
+    return ((needed & ~stored) == 0) ? PLAN_COVERING_INDEX : PLAN_INDEX;
+}
+
+void print_plan(Statement* statement, SelectPlan plan, Index* index) {
+    Table* table = statement->table;
+    ColumnDef* columns = table->schema.columns;
+    switch (plan) {
+        case PLAN_FULL_SCAN:
+            fprintf(output_stream(), "SCAN %s\n", table->name);
+            break;
+        case PLAN_PRIMARY_KEY:
+            fprintf(output_stream(), "SEARCH %s USING PRIMARY KEY (%s=?)\n", table->name, columns[KEY_COLUMN].name);
+            break;
+        case PLAN_PRIMARY_KEY_PREFIX:
+            fprintf(output_stream(), "SEARCH %s USING PRIMARY KEY PREFIX (%s=?)\n", table->name, columns[KEY_COLUMN].name);
+            break;
+        case PLAN_HASH_INDEX:
+            fprintf(output_stream(), "SEARCH %s USING HASH INDEX (%s=?)\n", table->name, columns[KEY_COLUMN].name);
+            break;
+        case PLAN_INDEX:
+            fprintf(output_stream(), "SEARCH %s USING INDEX %s\n", table->name, columns[index->column].name);
+            break;
+        case PLAN_COVERING_INDEX:
+            fprintf(output_stream(), "SEARCH %s USING COVERING INDEX %s\n", table->name, columns[index->column].name);
+            break;
+        case PLAN_NO_MATCH:
+            fprintf(output_stream(), "SEARCH %s USING DICTIONARY (%s=?)\n", table->name, columns[statement->where_column].name);
+            break;
+        case PLAN_COLUMN_STORE:
+            fprintf(output_stream(), "SCAN %s USING COLUMN STORE\n", table->name);
+            break;
+    }
+    if (statement->has_order_by) {
+        fprintf(output_stream(), "USE TOP-K HEAP FOR ORDER BY %s\n", columns[statement->order_by].name);
+    }
+}
+
+/*
+    Run a select through the access path chosen by the planner. ORDER BY
+    on a non-key column keeps only the first limit + offset rows in a
+    bounded heap instead of sorting every row.
+*/
+ExecuteResult execute_select(Statement* statement) {
+    Table* table = statement->table;
+    Index* index;
+    SelectPlan plan = plan_select(statement, table, &index);
+
+    if (statement->explain) {
+        if (statement->num_aggregates > 0 && table->column_store_page_num != 0) {
+            fprintf(output_stream(), "AGGREGATE %s USING COLUMN STORE\n", table->name);
+        } else if (statement->num_aggregates > 0) {
+            fprintf(output_stream(), "AGGREGATE %s\n", table->name);
+        } else {
+            print_plan(statement, plan, index);
+        }
+        return EXECUTE_SUCCESS;
+    }
+
+    if (statement->num_aggregates > 0) {
+        return execute_aggregate(statement);
+    }
+
+    RowSink sink;
+    sink.statement = statement;
+    sink.heap = NULL;
+    sink.to_skip = statement->offset;
+    sink.remaining = statement->has_limit ? statement->limit : UINT32_MAX;
+
+    if (statement->has_order_by) {
+        uint64_t wanted = table_count(table);
+        if (statement->has_limit && (uint64_t)statement->limit + statement->offset < wanted) {
+            wanted = (uint64_t)statement->limit + statement->offset;
+        }
+        sink.heap = top_k_new(&table->schema, statement->order_by, wanted);
+    }
+
+    RowBatch* batch = malloc(sizeof(RowBatch));
+    switch (plan) {
+        case PLAN_NO_MATCH:
+            break;
+        case PLAN_FULL_SCAN:
+            scan_table(statement, table, &sink, batch);
+            break;
+        case PLAN_PRIMARY_KEY:
+            lookup_id(statement, table, &sink, batch);
+            break;
+        case PLAN_PRIMARY_KEY_PREFIX:
+            scan_key_prefix(statement, table, &sink, batch);
+            break;
+        case PLAN_HASH_INDEX:
+            lookup_hash(statement, table, index, &sink, batch);
+            break;
+        case PLAN_INDEX:
+            scan_index(statement, table, index, false, &sink, batch);
+            break;
+        case PLAN_COVERING_INDEX:
+            scan_index(statement, table, index, true, &sink, batch);
+            break;
+        case PLAN_COLUMN_STORE:
+            scan_column_store(statement, table, &sink, batch);
+            break;
+    }
+
+    if (sink.heap != NULL) {
+        top_k_sort(sink.heap);
+        for (uint32_t i = statement->offset; i < sink.heap->size; i++) {
+            for (Column column = 0; column < table->schema.num_columns; column++) {
+                batch->columns[column][0] = sink.heap->entries[i].values[column];
+            }
+            print_batch_row(batch, 0, statement);
+        }
+        top_k_free(sink.heap);
+    }
+
+    free(batch);
+
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_create_index(Statement* statement, Database* db) {
+    Table* table = statement->table;
+    if (table_index_on(table, statement->index_column, statement->index_type) != NULL) {
+        return EXECUTE_INDEX_EXISTS;
+    }
+
+    uint32_t root_page_num = get_unused_page_num(table->pager);
+    void* root = get_page(table->pager, root_page_num);
+    if (statement->index_type == INDEX_HASH) {
+        hash_index_initialize(table->pager, root_page_num, table->schema.key_size, table->schema.row_size);
+    } else {
+        initialize_index_leaf_node(root);
+        set_node_root(root, true);
+    }
+
+    Index* index = &table->indexes[table->num_indexes++];
+    index->type = statement->index_type;
+    index->column = statement->index_column;
+    index->include_mask = statement->index_include_mask;
+    index->root_page_num = root_page_num;
+    catalog_write_table(db, table);
+
+    // Build the index from the rows already in the table
+    Cursor* cursor = table_start(table);
     Row row;
     while (!(cursor->end_of_table)) {
-        deserialize_row(cursor_value(cursor), &row);
-        print_row(&row);
+        deserialize_row(&table->schema, cursor_value(cursor), &row);
+        table_decode_dictionaries(table, &row);
+        index_insert_row(table, index, &row, cursor_value(cursor));
         cursor_advance(cursor);
     }
+    cursor_close(cursor);
 
-    free(cursor);
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_create_table(Statement* statement, Database* db) {
+    if (db_find_table(db, statement->table_name) != NULL) {
+        return EXECUTE_TABLE_EXISTS;
+    }
+    if (db->num_tables >= DATABASE_MAX_TABLES) {
+        return EXECUTE_TOO_MANY_TABLES;
+    }
+
+    db_create_table(db, statement->table_name, &statement->schema);
+    return EXECUTE_SUCCESS;
+}
+
+ExecuteResult execute_create_column_store(Statement* statement, Database* db) {
+    Table* table = statement->table;
+    if (table->column_store_page_num != 0) {
+        return EXECUTE_COLUMN_STORE_EXISTS;
+    }
 
+    column_store_create(table);
+    catalog_write_table(db, table);
     return EXECUTE_SUCCESS;
 }
 
-ExecuteResult execute_statement(Statement* statement, Table* table) {
+/*
+    Explicit transactions. Between begin and commit the statements of one
+    session are a unit: commit makes them durable together with one sync
+    of the file, and rollback undoes them. Other sessions run nothing
+    until the transaction ends, so none of them sees its rows before
+    commit. The catalog cannot change inside a transaction.
+*/
+ExecuteResult execute_begin(Database* db) {
+    if (db->in_transaction) {
+        return EXECUTE_TRANSACTION_OPEN;
+    }
+    pager_begin(db->pager);
+    pthread_mutex_lock(&db->transaction_lock);
+    db->in_transaction = true;
+    db->transaction_session = current_session;
+    pthread_mutex_unlock(&db->transaction_lock);
+    return EXECUTE_SUCCESS;
+}
+
+void db_end_transaction(Database* db) {
+    pthread_mutex_lock(&db->transaction_lock);
+    db->in_transaction = false;
+    pthread_mutex_unlock(&db->transaction_lock);
+}
+
+ExecuteResult execute_commit(Database* db) {
+    if (!db->in_transaction) {
+        return EXECUTE_NO_TRANSACTION;
+    }
+    pager_commit(db->pager);
+    db_end_transaction(db);
+    return EXECUTE_SUCCESS;
+}
+
+// Put back the pages as they were at begin, and what was read from them
+void db_rollback(Database* db) {
+    pager_rollback(db->pager);
+    for (uint32_t i = 0; i < db->num_tables; i++) {
+        table_reload_dictionaries(db->tables[i]);
+    }
+    db_end_transaction(db);
+}
+
+ExecuteResult execute_rollback(Database* db) {
+    if (!db->in_transaction) {
+        return EXECUTE_NO_TRANSACTION;
+    }
+    db_rollback(db);
+    return EXECUTE_SUCCESS;
+}
+
+// Whether another session's transaction keeps the calling one waiting
+bool db_transaction_blocks(Database* db) {
+    pthread_mutex_lock(&db->transaction_lock);
+    bool blocked = db->in_transaction && db->transaction_session != current_session;
+    pthread_mutex_unlock(&db->transaction_lock);
+    return blocked;
+}
+
+// A session going away rolls back the transaction it left open
+void db_end_session(Database* db) {
+    pthread_mutex_lock(&db->transaction_lock);
+    bool owner = db->in_transaction && db->transaction_session == current_session;
+    pthread_mutex_unlock(&db->transaction_lock);
+    if (!owner) {
+        return;
+    }
+    db_acquire(db, ACCESS_EXCLUSIVE);
+    db_rollback(db);
+    db_release(db, ACCESS_EXCLUSIVE);
+}
+
+bool table_has_dictionaries(Table* table) {
+    for (Column column = 0; column < table->schema.num_columns; column++) {
+        if (table->dictionaries[column] != NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Only the primary tree latches its pages. Inserts into a table with
+    nothing but its primary tree, and any select that reads nothing else,
+    share the database, writers included. An insert that also changes an
+    index, a dictionary or the column store is the single writer. A select
+    through an index, a dictionary or the column store, or one keeping row
+    pointers in a top-k heap past the leaf they point into, runs alone, as
+    do the statements that change the catalog.
+*/
+StatementAccess statement_access(Statement* statement) {
+    Table* table = statement->table;
+    switch (statement->type) {
+        case STATEMENT_INSERT:
+            if (table->num_indexes > 0 || table_has_dictionaries(table) || table->column_store_page_num != 0) {
+                return ACCESS_WRITE;
+            }
+            return ACCESS_SHARED;
+        case STATEMENT_SELECT:
+            break;
+        default:
+            return ACCESS_EXCLUSIVE;
+    }
+
+    if (table->column_store_page_num != 0 || table_has_dictionaries(table) || statement->has_order_by) {
+        return ACCESS_EXCLUSIVE;
+    }
+    Index* index;
+    SelectPlan plan = plan_select(statement, table, &index);
+    bool latched = plan == PLAN_FULL_SCAN || plan == PLAN_PRIMARY_KEY || plan == PLAN_PRIMARY_KEY_PREFIX;
+    return latched ? ACCESS_SHARED : ACCESS_EXCLUSIVE;
+}
+
+void db_acquire(Database* db, StatementAccess access) {
+    if (access == ACCESS_EXCLUSIVE) {
+        pthread_rwlock_wrlock(&db->lock);
+        return;
+    }
+    pthread_rwlock_rdlock(&db->lock);
+    if (access == ACCESS_WRITE) {
+        pthread_mutex_lock(&db->writer_lock);
+    }
+}
+
+
+void db_release(Database* db, StatementAccess access) {
+    if (access == ACCESS_WRITE) {
+        pthread_mutex_unlock(&db->writer_lock);
+    }
+    pthread_rwlock_unlock(&db->lock);
+}
+
+/*
+    Lock the database for a statement of the calling session. Returns false,
+    holding nothing, while another session's transaction is open. A begin
+    runs with the database locked exclusively, so no transaction starts
+    under a statement that got in.
+*/
+bool db_try_acquire(Database* db, StatementAccess access) {
+    db_acquire(db, access);
+    if (db_transaction_blocks(db)) {
+        db_release(db, access);
+        return false;
+    }
+    return true;
+}
+
+ExecuteResult execute_statement(Statement* statement, Database* db) {
+    bool changes_catalog = statement->type == STATEMENT_CREATE_INDEX || statement->type == STATEMENT_CREATE_TABLE ||
+                           statement->type == STATEMENT_CREATE_COLUMN_STORE;
+    if (changes_catalog && db->in_transaction) {
+        return EXECUTE_IN_TRANSACTION;
+    }
+
     switch (statement->type) {
         case STATEMENT_INSERT:
-            return execute_insert(statement, table);
+            return execute_insert(statement);
         case STATEMENT_SELECT:
-            return execute_select(statement, table);
+            return execute_select(statement);
+        case STATEMENT_CREATE_INDEX:
+            return execute_create_index(statement, db);
+        case STATEMENT_CREATE_TABLE:
+            return execute_create_table(statement, db);
+        case STATEMENT_CREATE_COLUMN_STORE:
+            return execute_create_column_store(statement, db);
+        case STATEMENT_BEGIN:
+            return execute_begin(db);
+        case STATEMENT_COMMIT:
+            return execute_commit(db);
+        case STATEMENT_ROLLBACK:
+            return execute_rollback(db);
     }
 }
@@ -0,0 +1,69 @@
+#include "../include/db.h"
+
+/*
+    Normalized primary keys. The key columns are stored big-endian back to
+    back in schema order, so a single memcmp over the table's key size
+    orders keys by their first column, then their second, and so on. The
+    B-tree search loops compare keys without looking at the schema.
+*/
+
+void encode_big_endian(uint64_t value, uint32_t size, uint8_t* destination) {
+    for (uint32_t i = 0; i < size; i++) {
+        destination[i] = value >> (8 * (size - 1 - i));
+    }
+}
+
+uint64_t decode_big_endian(uint8_t* source, uint32_t size) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        value = (value << 8) | source[i];
+    }
+    return value;
+}
+
+void key_encode(Schema* schema, Row* row, uint8_t* destination) {
+    for (Column column = 0; column < schema->num_key_columns; column++) {
+        encode_big_endian(row->values[column].integer, schema->columns[column].size,
+                          destination + schema->offsets[column]);
+    }
+}
+
+uint64_t key_column_decode(Schema* schema, void* key, Column column) {
+    return decode_big_endian((uint8_t*)key + schema->offsets[column], schema->columns[column].size);
+}
+
+// Turn the key into its successor in memcmp order. Returns false if it was already the largest key.
+bool key_increment(uint8_t* key, uint32_t size) {
+    for (int32_t i = size - 1; i >= 0; i--) {
+        if (++key[i] != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Number of leading bytes two keys have in common
+uint32_t common_prefix_size(uint8_t* a, uint8_t* b, uint32_t size) {
+    uint32_t length = 0;
+    while (length < size && a[length] == b[length]) {
+        length++;
+    }
+    return length;
+}
+
+// A single-column key prints as its value, a composite key as a tuple
+void print_key(Schema* schema, void* key) {
+    if (schema->num_key_columns == 1) {
+        fprintf(output_stream(), "%llu", (unsigned long long)key_column_decode(schema, key, KEY_COLUMN));
+        return;
+    }
+
+    fprintf(output_stream(), "(");
+    for (Column column = 0; column < schema->num_key_columns; column++) {
+        if (column > 0) {
+            fprintf(output_stream(), ", ");
+        }
+        fprintf(output_stream(), "%llu", (unsigned long long)key_column_decode(schema, key, column));
+    }
+    fprintf(output_stream(), ")");
+}
@@ -1,5 +1,108 @@
 #include "../include/db.h"
 
+/*
+    Run one line of input, a meta-command or a statement, and print its
+    outcome. Sessions of server mode call this from several threads at
+    once: the statement is prepared with the catalog held shared, and then
+    run with the access statement_access() asks for. Returns false, having
+    run and printed nothing, while another session's transaction is open.
+*/
+bool process_input(InputBuffer* input_buffer, Database* db) {
+    FILE* output = output_stream();
+
+    if (input_buffer->buffer[0] == '.') {
+        if (!db_try_acquire(db, ACCESS_EXCLUSIVE)) {
+            return false;
+        }
+        MetaCommandResult result = do_meta_command(input_buffer, db);
+        db_release(db, ACCESS_EXCLUSIVE);
+        switch (result) {
+            case (META_COMMAND_SUCCESS):
+                return true;
+            case (META_COMMAND_UNRECOGNIZED_COMMAND):
+                fprintf(output, "Unrecognized command '%s'\n", input_buffer->buffer);
+                return true;
+        }
+    }
+
+    Statement statement;
+    if (!db_try_acquire(db, ACCESS_SHARED)) {
+        return false;
+    }
+    pthread_mutex_lock(&db->parse_lock);
+    PrepareResult prepared = prepare_statement(input_buffer, &statement, db);
+    pthread_mutex_unlock(&db->parse_lock);
+    StatementAccess access = ACCESS_SHARED;
+    if (prepared == PREPARE_SUCCESS) {
+        access = statement_access(&statement);
+    }
+    db_release(db, ACCESS_SHARED);
+
+    switch (prepared) {
+        case (PREPARE_SUCCESS):
+            break;
+        case (PREPARE_NEGATIVE_ID):
+            fprintf(output, "ID must be positive.\n");
+            return true;
+        case (PREPARE_STRING_TOO_LONG):
+            fprintf(output, "String is too long.\n");
+            return true;
+        case (PREPARE_UNRECOGNIZED_COLUMN):
+            fprintf(output, "Unrecognized column.\n");
+            return true;
+        case (PREPARE_UNRECOGNIZED_TABLE):
+            fprintf(output, "Unrecognized table.\n");
+            return true;
+        case (PREPARE_SYNTAX_ERROR):
+            fprintf(output, "Syntax error. Could not parse statement.\n");
+            return true;
+        case (PREPARE_UNRECOGNIZED_STATEMENT):
+            fprintf(output, "Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
+            return true;
+    }
+
+    if (!db_try_acquire(db, access)) {
+        return false;
+    }
+    ExecuteResult result = execute_statement(&statement, db);
+    db_release(db, access);
+
+    switch (result) {
+        case (EXECUTE_SUCCESS):
+            fprintf(output, "Executed.\n");
+            break;
+        case (EXECUTE_DUPLICATE_KEY):
+            fprintf(output, "Error: Duplicate key.\n");
+            break;
+        case (EXECUTE_TABLE_FULL):
+            fprintf(output, "Error: Table full.\n");
+            break;
+        case (EXECUTE_INDEX_EXISTS):
+            fprintf(output, "Error: Index already exists.\n");
+            break;
+        case (EXECUTE_TABLE_EXISTS):
+            fprintf(output, "Error: Table already exists.\n");
+            break;
+        case (EXECUTE_TOO_MANY_TABLES):
+            fprintf(output, "Error: Too many tables.\n");
+            break;
+        case (EXECUTE_COLUMN_STORE_EXISTS):
+            fprintf(output, "Error: Column store already exists.\n");
+            break;
+        case (EXECUTE_TRANSACTION_OPEN):
+            fprintf(output, "Error: Transaction already open.\n");
+            break;
+        case (EXECUTE_NO_TRANSACTION):
+            fprintf(output, "Error: No transaction is open.\n");
+            break;
+        case (EXECUTE_IN_TRANSACTION):
+            fprintf(output, "Error: Not allowed in a transaction.\n");
+            break;
+    }
+    return true;
+}
+
+// SimpleSQL <db> reads statements from stdin, SimpleSQL <db> --listen <socket> serves them
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         printf("Must supply a database filename.\n");
@@ -7,51 +110,19 @@ int main(int argc, char* argv[]) {
     }
 
     char* filename = argv[1];
-    Table* table = db_open(filename);
+    Database* db = db_open(filename);
+
+    if (argc == 4 && strcmp(argv[2], "--listen") == 0) {
+        server_run(db, argv[3]);
+    } else if (argc != 2) {
+        printf("Usage: %s <db> [--listen <socket>]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
 
     InputBuffer* input_buffer = new_input_buffer();
     while (true) {
         print_prompt();
         read_input(input_buffer);
-
-        if (input_buffer->buffer[0] == '.') {
-            switch (do_meta_command(input_buffer, table)) {
-                case (META_COMMAND_SUCCESS):
-                    continue;
-                case (META_COMMAND_UNRECOGNIZED_COMMAND):
-                    printf("Unrecognized command '%s'\n", input_buffer->buffer);
-                    continue;
-            }
-        }
-
-        Statement statement;
-        switch (prepare_statement(input_buffer, &statement)) {
-            case (PREPARE_SUCCESS):
-                break;
-            case (PREPARE_NEGATIVE_ID):
-                printf("ID must be positive.\n");
-                continue;
-            case (PREPARE_STRING_TOO_LONG):
-                printf("String is too long.\n");
-                continue;
-            case (PREPARE_SYNTAX_ERROR):
-                printf("Syntax error. Could not parse statement.\n");
-                continue;
-            case (PREPARE_UNRECOGNIZED_STATEMENT):
-                printf("Unrecognized keyword at start of '%s'.\n", input_buffer->buffer);
-                continue;
-        }
-
-        switch (execute_statement(&statement, table)) {
-            case (EXECUTE_SUCCESS):
-                printf("Executed.\n");
-                break;
-            case (EXECUTE_DUPLICATE_KEY):
-                printf("Error: Duplicate key.\n");
-                break;
-            case (EXECUTE_TABLE_FULL):
-                printf("Error: Table full.\n");
-                break;
-        }
+        process_input(input_buffer, db);
     }
 }
@@ -1,5 +1,74 @@
 #include "../include/db.h"
 
+// Positioned reads and writes, so the checkpointer can write while pages are loaded
+void pager_read(Pager* pager, off_t offset, void* destination, uint32_t size) {
+    ssize_t bytes_read = pread(pager->file_descriptor, destination, size, offset);
+
+    if (bytes_read == -1) {
+        printf("Error reading file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+void pager_write(Pager* pager, off_t offset, void* source, uint32_t size) {
+    ssize_t bytes_written = pwrite(pager->file_descriptor, source, size, offset);
+
+    if (bytes_written == -1) {
+        printf("Error writing: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Note that the file now holds this image of the page
+void pager_mark_clean(Pager* pager, uint32_t page_num, void* page) {
+    if (pager->shadows[page_num] == NULL) {
+        pager->shadows[page_num] = malloc(PAGE_SIZE);
+    }
+    memcpy(pager->shadows[page_num], page, PAGE_SIZE);
+}
+
+// Load the page map of a compressed file. Returns false for a plain file.
+bool pager_read_map(Pager* pager) {
+    uint8_t map[PAGE_MAP_SIZE];
+    pager_read(pager, 0, map, PAGE_MAP_SIZE);
+    if (*(uint32_t*)(map + PAGE_MAP_MAGIC_OFFSET) != PAGE_MAP_MAGIC) {
+        return false;
+    }
+
+    pager->num_stored_pages = *(uint32_t*)(map + PAGE_MAP_NUM_PAGES_OFFSET);
+    if (pager->num_stored_pages > TABLE_MAX_PAGES) {
+        printf("Page map is larger than the database. Corrupt file.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (uint32_t i = 0; i < pager->num_stored_pages; i++) {
+        uint8_t* entry = map + PAGE_MAP_ENTRIES_OFFSET + i * PAGE_MAP_ENTRY_SIZE;
+        pager->stored_offsets[i] = *(uint32_t*)entry;
+        pager->stored_sizes[i] = *(uint32_t*)(entry + sizeof(uint32_t));
+        if (pager->stored_sizes[i] > PAGE_SIZE ||
+            (uint64_t)pager->stored_offsets[i] + pager->stored_sizes[i] > pager->file_length) {
+            printf("Page map points past the end of the file. Corrupt file.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return true;
+}
+
+// Read a page through the page map, decompressing it unless it was stored raw
+void pager_read_mapped(Pager* pager, uint32_t page_num, void* page) {
+    uint32_t stored_size = pager->stored_sizes[page_num];
+    if (stored_size == PAGE_SIZE) {
+        pager_read(pager, pager->stored_offsets[page_num], page, PAGE_SIZE);
+        return;
+    }
+
+    uint8_t stored[PAGE_SIZE];
+    pager_read(pager, pager->stored_offsets[page_num], stored, stored_size);
+    if (!page_decompress(stored, stored_size, page, PAGE_SIZE)) {
+        printf("Compressed page %d is corrupt.\n", page_num);
+        exit(EXIT_FAILURE);
+    }
+}
+
 Pager* pager_open(const char* filename) {
     int fd = open(filename,
         O_RDWR |    // Read/Write mode
@@ -18,20 +87,50 @@ Pager* pager_open(const char* filename) {
     Pager* pager = malloc(sizeof(Pager));
     pager->file_descriptor = fd;
     pager->file_length = file_length;
+    pager->num_pages = (file_length / PAGE_SIZE);
+    pager->compress = false;
+    pager->mapped = false;
+    pager->num_stored_pages = 0;
+    pager->num_reserved_pages = 0;
 
+    pthread_mutex_init(&pager->lock, NULL);
     for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
         pager->pages[i] = NULL;
+        pthread_rwlock_init(&pager->latches[i], NULL);
+        pager->versions[i] = 0;
+        pager->row_versions[i] = 0;
+        pager->shadows[i] = NULL;
+    }
+    pager->transaction_num_pages = 0;
+    pager->synchronous = SYNCHRONOUS_FULL;
+
+    if (file_length >= PAGE_MAP_SIZE && pager_read_map(pager)) {
+        // A compressed file stays compressed until told otherwise
+        pager->mapped = true;
+        pager->compress = true;
+        pager->num_pages = pager->num_stored_pages;
+    } else if (file_length % PAGE_SIZE != 0) {
+        printf("Db file is not a whole number of pages. Corrupt file.\n");
+        exit(EXIT_FAILURE);
     }
 
+    wal_open(pager, filename);
     return pager;
 }
 
 void* get_page(Pager* pager, uint32_t page_num) {
-    if (page_num > TABLE_MAX_PAGES) {
+    if (page_num >= TABLE_MAX_PAGES) {
         printf("Tried to fetch page number out of bonds. %d > %d\n", page_num, TABLE_MAX_PAGES);
         exit(EXIT_FAILURE);
     }
 
+    // Cached pages stay put until close, so a hit needs no lock
+    void* cached = __atomic_load_n(&pager->pages[page_num], __ATOMIC_ACQUIRE);
+    if (cached != NULL) {
+        return cached;
+    }
+
+    pthread_mutex_lock(&pager->lock);
     if (pager->pages[page_num] == NULL) {
         // Cache miss. Allocate memory and load from file
         void* page = malloc(PAGE_SIZE);
@@ -42,60 +141,296 @@ void* get_page(Pager* pager, uint32_t page_num) {
             num_pages += 1;
         }
 
-        if (page_num <= num_pages) {
-            lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-            ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
-
-            if (bytes_read == -1) {
-                printf("Error reading file: %d\n", errno);
-                exit(EXIT_FAILURE);
-            }
+        bool stored = pager->mapped ? page_num < pager->num_stored_pages : page_num < num_pages;
+        if (pager->mapped && stored) {
+            pager_read_mapped(pager, page_num, page);
+        } else if (stored) {
+            pager_read(pager, page_num * PAGE_SIZE, page, PAGE_SIZE);
+        }
+        if (stored) {
+            pager_mark_clean(pager, page_num, page);
         }
 
-        pager->pages[page_num] = page;
+        __atomic_store_n(&pager->pages[page_num], page, __ATOMIC_RELEASE);
+
+        if (page_num >= pager->num_pages) {
+            pager->num_pages = page_num + 1;
+        }
     }
+    pthread_mutex_unlock(&pager->lock);
 
     return pager->pages[page_num];
 }
 
+/*
+    Latch a page's frame. Tree code holds a shared latch while it reads a
+    node and an exclusive one while it changes it, so readers and the
+    writer see every node whole. Latches are taken top-down, parent before
+    child, or left to right along a level, which keeps them free of
+    deadlocks.
+*/
+void pager_latch(Pager* pager, uint32_t page_num, LatchMode mode) {
+    if (mode == LATCH_SHARED) {
+        pthread_rwlock_rdlock(&pager->latches[page_num]);
+        return;
+    }
+    pthread_rwlock_wrlock(&pager->latches[page_num]);
+    // An odd version tells optimistic readers the frame is being changed
+    uint64_t version = pager->versions[page_num];
+    __atomic_store_n(&pager->versions[page_num], version + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// Only an exclusive holder sees an odd version, since it keeps shared holders out
+void pager_unlatch(Pager* pager, uint32_t page_num) {
+    uint64_t version = __atomic_load_n(&pager->versions[page_num], __ATOMIC_RELAXED);
+    if (version & 1) {
+        __atomic_store_n(&pager->versions[page_num], version + 1, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&pager->latches[page_num]);
+}
+
+/*
+    Optimistic reads. A reader notes a frame's version before reading the
+    node in it and checks the version is unchanged afterwards, instead of
+    latching it, so readers never write to the shared latch. A changed
+    version means a writer got in between and what was read is stale.
+*/
+uint64_t pager_read_begin(Pager* pager, uint32_t page_num) {
+    while (true) {
+        uint64_t version = __atomic_load_n(&pager->versions[page_num], __ATOMIC_ACQUIRE);
+        if (!(version & 1)) {
+            return version;
+        }
+        sched_yield();
+    }
+}
+
+bool pager_read_validate(Pager* pager, uint32_t page_num, uint64_t version) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&pager->versions[page_num], __ATOMIC_RELAXED) == version;
+}
+
 void pager_flush(Pager* pager, uint32_t page_num) {
     if (pager->pages[page_num] == NULL) {
         printf("Tried to flush null page\n");
         exit(EXIT_FAILURE);
     }
 
-    off_t offset = lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
+    pager_write(pager, page_num * PAGE_SIZE, pager->pages[page_num], PAGE_SIZE);
+    pager_mark_clean(pager, page_num, pager->pages[page_num]);
+    pager->unwritten[page_num] = false;
+}
 
-    if (offset == -1) {
-        printf("Error seeking: %d\n", errno);
-        exit(EXIT_FAILURE);
+/*
+    Write every page back through the page map. Compressed pages do not
+    sit at fixed offsets, so the whole file is rewritten: all pages are
+    loaded first, then packed back to back after the map, compressed when
+    that saves space and raw otherwise. Pages are only compressed on their
+    way to disk; the cache keeps them uncompressed.
+*/
+void pager_write_compressed(Pager* pager) {
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        get_page(pager, i);
     }
 
-    ssize_t bytes_written = write(pager->file_descriptor, pager->pages[page_num], PAGE_SIZE);
+    uint8_t map[PAGE_MAP_SIZE];
+    memset(map, 0, PAGE_MAP_SIZE);
+    *(uint32_t*)(map + PAGE_MAP_MAGIC_OFFSET) = PAGE_MAP_MAGIC;
+    *(uint32_t*)(map + PAGE_MAP_NUM_PAGES_OFFSET) = pager->num_pages;
 
-    if (bytes_written == -1) {
-        printf("Error writing: %d\n", errno);
-        exit(EXIT_FAILURE);
+    uint8_t compressed[PAGE_SIZE];
+    uint32_t offset = PAGE_MAP_SIZE;
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        void* image = compressed;
+        uint32_t size = page_compress(pager->pages[i], PAGE_SIZE, compressed, PAGE_SIZE - 1);
+        if (size == 0) {
+            image = pager->pages[i];
+            size = PAGE_SIZE;
+        }
+        pager_write(pager, offset, image, size);
+        pager_mark_clean(pager, i, pager->pages[i]);
+        pager->unwritten[i] = false;
+
+        uint8_t* entry = map + PAGE_MAP_ENTRIES_OFFSET + i * PAGE_MAP_ENTRY_SIZE;
+        *(uint32_t*)entry = offset;
+        *(uint32_t*)(entry + sizeof(uint32_t)) = size;
+        pager->stored_offsets[i] = offset;
+        pager->stored_sizes[i] = size;
+        offset += size;
     }
+
+    pager_write(pager, 0, map, PAGE_MAP_SIZE);
+    ftruncate(pager->file_descriptor, offset);
+    pager->file_length = offset;
+    pager->num_stored_pages = pager->num_pages;
+    pager->mapped = true;
 }
 
-// Until we start recycling free pages, new pages will always go to the end of the database file
-uint32_t get_unused_page_num(Pager* pager) {
-    return pager->file_length / PAGE_SIZE;
+// Turning compression off rewrites a compressed file as plain pages
+void pager_write_uncompressed(Pager* pager) {
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        get_page(pager, i);
+    }
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        pager_flush(pager, i);
+    }
+    ftruncate(pager->file_descriptor, (off_t)pager->num_pages * PAGE_SIZE);
+    pager->file_length = pager->num_pages * PAGE_SIZE;
+    pager->mapped = false;
 }
 
-void db_close(Table* table) {
-    Pager* pager = table->pager;
+// A cached page is dirty when it differs from the file's copy, or the file has none
+bool pager_page_dirty(Pager* pager, uint32_t page_num) {
+    return pager->pages[page_num] != NULL &&
+           (pager->shadows[page_num] == NULL || memcmp(pager->pages[page_num], pager->shadows[page_num], PAGE_SIZE) != 0);
+}
 
+// A page is unsaved while the file lacks its latest image, committed or not
+bool pager_page_unsaved(Pager* pager, uint32_t page_num) {
+    return pager_page_dirty(pager, page_num) || pager->unwritten[page_num];
+}
+
+bool pager_has_unsaved_pages(Pager* pager) {
     for (uint32_t i = 0; i < pager->num_pages; i++) {
-        if (pager->pages[i] == NULL) {
-            continue;
+        if (pager_page_unsaved(pager, i)) {
+            return true;
         }
+    }
+    return false;
+}
 
-        pager_flush(pager, i);
+/*
+    Write the unsaved pages back to the file. A compressed file keeps no page
+    at a fixed offset, so it is rewritten whole if anything changed, and
+    so is a file switching to or from compression.
+*/
+void pager_write_back(Pager* pager) {
+    if (pager->compress || pager->mapped) {
+        if (pager->compress != pager->mapped || pager_has_unsaved_pages(pager)) {
+            if (pager->compress) {
+                pager_write_compressed(pager);
+            } else {
+                pager_write_uncompressed(pager);
+            }
+        }
+        return;
+    }
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        if (pager_page_unsaved(pager, i)) {
+            pager_flush(pager, i);
+        }
+    }
+}
+
+// Make what was written to the file or the log durable, as far as the synchronous setting asks
+void pager_sync(Pager* pager, int fd) {
+    int result = 0;
+    switch (__atomic_load_n(&pager->synchronous, __ATOMIC_RELAXED)) {
+        case SYNCHRONOUS_OFF:
+            return;
+        case SYNCHRONOUS_NORMAL:
+            result = fdatasync(fd);
+            break;
+        case SYNCHRONOUS_FULL:
+            result = fsync(fd);
+            break;
+    }
+    if (result == -1) {
+        printf("Error syncing db file: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    Transactions. Statements change pages in place in the cache, and each
+    page's shadow, its last committed image, is what a rollback puts back.
+    A transaction begins by logging the dirty pages, so every page it
+    leaves alone matches its shadow. It ends by logging the pages that
+    differ and syncing the log once (commit), or by restoring them and
+    dropping the pages it allocated (rollback).
+*/
+void pager_begin(Pager* pager) {
+    wal_log_dirty_pages(pager, false);
+    pager->transaction_num_pages = pager->num_pages;
+}
+
+void pager_commit(Pager* pager) {
+    wal_log_dirty_pages(pager, true);
+}
+
+// The checkpointer leaves a file alone while it is or will be compressed
+void pager_set_compress(Pager* pager, bool compress) {
+    pthread_mutex_lock(&pager->checkpoint_lock);
+    pager->compress = compress;
+    pthread_mutex_unlock(&pager->checkpoint_lock);
+}
+
+void pager_rollback(Pager* pager) {
+    for (uint32_t i = 0; i < pager->transaction_num_pages; i++) {
+        if (pager_page_dirty(pager, i)) {
+            memcpy(pager->pages[i], pager->shadows[i], PAGE_SIZE);
+        }
+    }
+    for (uint32_t i = pager->transaction_num_pages; i < pager->num_pages; i++) {
         free(pager->pages[i]);
+        free(pager->shadows[i]);
         pager->pages[i] = NULL;
+        pager->shadows[i] = NULL;
+        pager->row_versions[i] = 0;
     }
+    pager->num_pages = pager->transaction_num_pages;
+}
+
+/*
+    Until we start recycling free pages, new pages will always go to the
+    end of the database file. The page is reserved, zeroed, before the lock
+    is let go, so writers splitting nodes at the same time get distinct
+    pages.
+*/
+uint32_t get_unused_page_num(Pager* pager) {
+    pthread_mutex_lock(&pager->lock);
+    uint32_t page_num = pager->num_pages;
+    if (page_num < TABLE_MAX_PAGES) {
+        __atomic_store_n(&pager->pages[page_num], calloc(1, PAGE_SIZE), __ATOMIC_RELEASE);
+        pager->num_pages = page_num + 1;
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return page_num;
+}
+
+/*
+    Set pages aside for a statement that may allocate them, so statements
+    running side by side cannot together outgrow the file. Returns false
+    if there is no room left.
+*/
+bool pager_reserve(Pager* pager, uint32_t num_pages) {
+    pthread_mutex_lock(&pager->lock);
+    bool reserved = pager->num_pages + pager->num_reserved_pages + num_pages <= TABLE_MAX_PAGES;
+    if (reserved) {
+        pager->num_reserved_pages += num_pages;
+    }
+    pthread_mutex_unlock(&pager->lock);
+    return reserved;
+}
+
+void pager_unreserve(Pager* pager, uint32_t num_pages) {
+    pthread_mutex_lock(&pager->lock);
+    pager->num_reserved_pages -= num_pages;
+    pthread_mutex_unlock(&pager->lock);
+}
+
+// Closing with a transaction open rolls it back
+void db_close(Database* db) {
+    Pager* pager = db->pager;
+
+    wal_stop_checkpointer(pager);
+    if (db->in_transaction) {
+        pager_rollback(pager);
+    }
+    pager_write_back(pager);
+    pager_sync(pager, pager->file_descriptor);
+    wal_remove(pager);
 
     int result = close(pager->file_descriptor);
     if (result == -1) {
@@ -108,8 +443,14 @@ void db_close(Table* table) {
             free(page);
             pager->pages[i] = NULL;
         }
+        free(pager->shadows[i]);
     }
 
     free(pager);
-    free(table);
+    for (uint32_t i = 0; i < db->num_tables; i++) {
+        table_free_dictionaries(db->tables[i]);
+        version_store_free(&db->tables[i]->versions);
+        free(db->tables[i]);
+    }
+    free(db);
 }
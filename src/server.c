@@ -0,0 +1,341 @@
+#include "../include/db.h"
+
+/*
+    Server mode. Clients connect to a Unix domain socket and talk to it
+    exactly like the REPL: one statement or meta-command per line, each
+    answered by its output and a new prompt. The main thread runs an epoll
+    event loop that accepts connections and waits for input; a readable
+    connection is armed one-shot, so it is handed to a single worker at a
+    time, and its statements run in the order they were sent. All clients
+    share the open database and its page cache; process_input() decides
+    which statements may run side by side. A connection whose next line
+    has to wait for another client's transaction is parked rather than
+    holding a worker, and queued again once the transaction ends. SIGINT
+    or SIGTERM flushes the database and stops the server.
+*/
+
+#define SERVER_READ_SIZE 4096
+
+void server_fail(const char* message) {
+    printf("%s: %d\n", message, errno);
+    exit(EXIT_FAILURE);
+}
+
+// Write all of buffer. Returns false if the client went away.
+bool send_all(int fd, const char* buffer, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, buffer, size, MSG_NOSIGNAL);
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sent == -1) {
+            return false;
+        }
+        buffer += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+// Read whatever the client has sent so far. Returns false at end of input or on error.
+bool connection_receive(Connection* connection) {
+    while (true) {
+        if (connection->pending_capacity - connection->pending_length < SERVER_READ_SIZE) {
+            connection->pending_capacity = connection->pending_capacity * 2 + SERVER_READ_SIZE;
+            connection->pending = realloc(connection->pending, connection->pending_capacity);
+        }
+        ssize_t received = recv(connection->fd, connection->pending + connection->pending_length,
+                                connection->pending_capacity - connection->pending_length, MSG_DONTWAIT);
+        if (received > 0) {
+            connection->pending_length += received;
+        } else if (received == 0) {
+            return false;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+void connection_close(Connection* connection) {
+    close(connection->fd);
+    free(connection->pending);
+    free(connection);
+}
+
+// Run one line for a client, sending back its output and the next prompt
+LineResult server_execute_line(Server* server, Connection* connection, char* line, size_t length) {
+    InputBuffer input_buffer = {line, length + 1, length};
+    char* output;
+    size_t output_size;
+    FILE* stream = open_memstream(&output, &output_size);
+    set_output_stream(stream);
+    set_session(connection);
+
+    bool executed = process_input(&input_buffer, server->db);
+    print_prompt();
+
+    set_session(NULL);
+    set_output_stream(NULL);
+    fclose(stream);
+    bool sent = !executed || send_all(connection->fd, output, output_size);
+    free(output);
+    if (!sent) {
+        return LINE_CLIENT_GONE;
+    }
+    return executed ? LINE_EXECUTED : LINE_BLOCKED;
+}
+
+void server_enqueue(Server* server, Connection* connection) {
+    pthread_mutex_lock(&server->queue_lock);
+    connection->next = NULL;
+    if (server->queue_tail == NULL) {
+        server->queue_head = connection;
+    } else {
+        server->queue_tail->next = connection;
+    }
+    server->queue_tail = connection;
+    pthread_cond_signal(&server->queue_ready);
+    pthread_mutex_unlock(&server->queue_lock);
+}
+
+/*
+    Set a connection aside until the open transaction ends. The check is
+    made again under the queue lock, which the client ending the
+    transaction takes afterwards to queue the parked connections, so a
+    connection cannot be parked after they were let go.
+*/
+void server_park(Server* server, Connection* connection) {
+    pthread_mutex_lock(&server->queue_lock);
+    set_session(connection);
+    bool blocked = db_transaction_blocks(server->db);
+    set_session(NULL);
+    if (blocked) {
+        connection->next = server->parked;
+        server->parked = connection;
+    }
+    pthread_mutex_unlock(&server->queue_lock);
+    if (!blocked) {
+        server_enqueue(server, connection);
+    }
+}
+
+// Queue the parked connections once no transaction holds them back
+void server_unpark(Server* server) {
+    pthread_mutex_lock(&server->queue_lock);
+    if (server->parked == NULL || db_transaction_blocks(server->db)) {
+        pthread_mutex_unlock(&server->queue_lock);
+        return;
+    }
+    Connection* parked = server->parked;
+    server->parked = NULL;
+    pthread_mutex_unlock(&server->queue_lock);
+
+    while (parked != NULL) {
+        Connection* next = parked->next;
+        server_enqueue(server, parked);
+        parked = next;
+    }
+}
+
+// Run every complete line the client has sent, then wait for more or hang up
+void server_serve(Server* server, Connection* connection) {
+    bool open = connection_receive(connection);
+    bool blocked = false;
+
+    size_t start = 0;
+    char* newline;
+    while ((newline = memchr(connection->pending + start, '\n', connection->pending_length - start)) != NULL) {
+        char* line = connection->pending + start;
+        size_t length = newline - line;
+        *newline = '\0';
+
+        // .exit ends this session only, the server keeps running
+        LineResult result = (strcmp(line, ".exit") == 0) ? LINE_CLIENT_GONE
+                                                         : server_execute_line(server, connection, line, length);
+        if (result == LINE_BLOCKED) {
+            *newline = '\n';
+            blocked = true;
+            break;
+        }
+        start += length + 1;
+        if (result == LINE_CLIENT_GONE) {
+            open = false;
+            break;
+        }
+    }
+    connection->pending_length -= start;
+    memmove(connection->pending, connection->pending + start, connection->pending_length);
+
+    if (blocked) {
+        // A client that hung up still has its remaining lines run first
+        server_park(server, connection);
+    } else if (!open) {
+        set_session(connection);
+        db_end_session(server->db);
+        set_session(NULL);
+        connection_close(connection);
+    } else {
+        struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = connection};
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event) == -1) {
+            connection_close(connection);
+        }
+    }
+    // The client may have just ended its transaction
+    server_unpark(server);
+}
+
+void* server_worker(void* argument) {
+    Server* server = argument;
+    while (true) {
+        pthread_mutex_lock(&server->queue_lock);
+        while (!server->stopping && server->queue_head == NULL) {
+            pthread_cond_wait(&server->queue_ready, &server->queue_lock);
+        }
+        Connection* connection = server->queue_head;
+        if (connection == NULL) {
+            pthread_mutex_unlock(&server->queue_lock);
+            return NULL;
+        }
+        server->queue_head = connection->next;
+        if (server->queue_head == NULL) {
+            server->queue_tail = NULL;
+        }
+        pthread_mutex_unlock(&server->queue_lock);
+
+        server_serve(server, connection);
+    }
+}
+
+void server_accept(Server* server) {
+    while (true) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) {
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            server_fail("Error accepting connection");
+        }
+
+        Connection* connection = malloc(sizeof(Connection));
+        connection->fd = fd;
+        connection->pending = NULL;
+        connection->pending_length = 0;
+        connection->pending_capacity = 0;
+        connection->next = NULL;
+
+        struct epoll_event event = {.events = EPOLLIN | EPOLLONESHOT, .data.ptr = connection};
+        if (!send_all(fd, "db > ", 5) || epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            connection_close(connection);
+        }
+    }
+}
+
+int server_listen(const char* socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Socket path too long.\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        server_fail("Error creating socket");
+    }
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+        server_fail("Error binding socket");
+    }
+    if (listen(fd, SOMAXCONN) == -1) {
+        server_fail("Error listening on socket");
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+void server_stop(Server* server, const char* socket_path) {
+    pthread_mutex_lock(&server->queue_lock);
+    server->stopping = true;
+    pthread_cond_broadcast(&server->queue_ready);
+    pthread_mutex_unlock(&server->queue_lock);
+    for (uint32_t i = 0; i < server->num_workers; i++) {
+        pthread_join(server->workers[i], NULL);
+    }
+
+    close(server->listen_fd);
+    unlink(socket_path);
+    close(server->epoll_fd);
+    close(server->signal_fd);
+    db_close(server->db);
+}
+
+// Serve the database on a Unix domain socket until SIGINT or SIGTERM. Does not return.
+void server_run(Database* db, const char* socket_path) {
+    Server server;
+    server.db = db;
+    server.queue_head = NULL;
+    server.queue_tail = NULL;
+    server.parked = NULL;
+    server.stopping = false;
+    pthread_mutex_init(&server.queue_lock, NULL);
+    pthread_cond_init(&server.queue_ready, NULL);
+
+    // Workers inherit the blocked signals, so only the event loop sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    server.signal_fd = signalfd(-1, &signals, 0);
+
+    server.listen_fd = server_listen(socket_path);
+    server.epoll_fd = epoll_create1(0);
+    if (server.signal_fd == -1 || server.epoll_fd == -1) {
+        server_fail("Error setting up event loop");
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = &server.listen_fd};
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &event);
+    event.data.ptr = &server.signal_fd;
+    epoll_ctl(server.epoll_fd, EPOLL_CTL_ADD, server.signal_fd, &event);
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    server.num_workers = (num_cpus < 1) ? 1 : (num_cpus > SERVER_MAX_WORKERS) ? SERVER_MAX_WORKERS : num_cpus;
+    for (uint32_t i = 0; i < server.num_workers; i++) {
+        pthread_create(&server.workers[i], NULL, server_worker, &server);
+    }
+
+    printf("Listening on %s\n", socket_path);
+    fflush(stdout);
+
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    bool running = true;
+    while (running) {
+        int num_events = epoll_wait(server.epoll_fd, events, SERVER_MAX_EVENTS, -1);
+        if (num_events == -1 && errno == EINTR) {
+            continue;
+        }
+        if (num_events == -1) {
+            server_fail("Error waiting for events");
+        }
+
+        for (int i = 0; i < num_events; i++) {
+            if (events[i].data.ptr == &server.listen_fd) {
+                server_accept(&server);
+            } else if (events[i].data.ptr == &server.signal_fd) {
+                running = false;
+            } else {
+                server_enqueue(&server, events[i].data.ptr);
+            }
+        }
+    }
+
+    server_stop(&server, socket_path);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,105 @@
+#include "../include/db.h"
+
+TopKHeap* top_k_new(Schema* schema, Column column, uint32_t capacity) {
+    TopKHeap* heap = malloc(sizeof(TopKHeap));
+    heap->schema = schema;
+    heap->column = column;
+    heap->capacity = capacity;
+    heap->size = 0;
+    heap->entries = malloc(sizeof(RowRef) * (capacity > 0 ? capacity : 1));
+    return heap;
+}
+
+void top_k_free(TopKHeap* heap) {
+    free(heap->entries);
+    free(heap);
+}
+
+// Order rows by the heap column, breaking ties on the key columns
+int row_ref_compare(TopKHeap* heap, RowRef* a, RowRef* b) {
+    BatchValue* x = &a->values[heap->column];
+    BatchValue* y = &b->values[heap->column];
+    int result;
+    if (column_is_integer(&heap->schema->columns[heap->column])) {
+        result = (x->integer > y->integer) - (x->integer < y->integer);
+    } else {
+        result = strcmp(x->text, y->text);
+    }
+
+    for (Column column = 0; result == 0 && column < heap->schema->num_key_columns; column++) {
+        uint64_t a_key = a->values[column].integer;
+        uint64_t b_key = b->values[column].integer;
+        result = (a_key > b_key) - (a_key < b_key);
+    }
+    return result;
+}
+
+void top_k_sift_down(TopKHeap* heap, uint32_t index, uint32_t size) {
+    RowRef* entries = heap->entries;
+    while (true) {
+        uint32_t largest = index;
+        uint32_t left = 2 * index + 1;
+        uint32_t right = left + 1;
+
+        if (left < size && row_ref_compare(heap, &entries[left], &entries[largest]) > 0) {
+            largest = left;
+        }
+        if (right < size && row_ref_compare(heap, &entries[right], &entries[largest]) > 0) {
+            largest = right;
+        }
+        if (largest == index) {
+            return;
+        }
+
+        RowRef temp = entries[index];
+        entries[index] = entries[largest];
+        entries[largest] = temp;
+        index = largest;
+    }
+}
+
+void top_k_sift_up(TopKHeap* heap, uint32_t index) {
+    RowRef* entries = heap->entries;
+    while (index > 0) {
+        uint32_t parent = (index - 1) / 2;
+        if (row_ref_compare(heap, &entries[index], &entries[parent]) <= 0) {
+            return;
+        }
+
+        RowRef temp = entries[index];
+        entries[index] = entries[parent];
+        entries[parent] = temp;
+        index = parent;
+    }
+}
+
+/*
+    Offer one row of the batch to the heap. The root is the largest row
+    kept so far; once the heap is full a new row only gets in by
+    replacing it.
+*/
+void top_k_offer(TopKHeap* heap, RowBatch* batch, uint32_t index) {
+    RowRef row;
+    for (Column column = 0; column < heap->schema->num_columns; column++) {
+        row.values[column] = batch->columns[column][index];
+    }
+
+    if (heap->size < heap->capacity) {
+        heap->entries[heap->size] = row;
+        top_k_sift_up(heap, heap->size);
+        heap->size += 1;
+    } else if (heap->capacity > 0 && row_ref_compare(heap, &row, &heap->entries[0]) < 0) {
+        heap->entries[0] = row;
+        top_k_sift_down(heap, 0, heap->size);
+    }
+}
+
+// Heapsort the kept rows in place into ascending order
+void top_k_sort(TopKHeap* heap) {
+    for (uint32_t size = heap->size; size > 1; size--) {
+        RowRef temp = heap->entries[0];
+        heap->entries[0] = heap->entries[size - 1];
+        heap->entries[size - 1] = temp;
+        top_k_sift_down(heap, 0, size - 1);
+    }
+}
@@ -1,78 +1,609 @@
 #include "../include/db.h"
 
-Table* db_open(const char* filename) {
-    Pager* pager = pager_open(filename);
+Index* table_index_on(Table* table, Column column, IndexType type) {
+    for (uint32_t i = 0; i < table->num_indexes; i++) {
+        if (table->indexes[i].column == column && table->indexes[i].type == type) {
+            return &table->indexes[i];
+        }
+    }
+    return NULL;
+}
 
-    Table* table = malloc(sizeof(Table));
-    table->pager = pager;
-    table->root_page_num = 0;
+// Columns are laid out back to back in schema order within a serialized row
+void schema_add_column(Schema* schema, const char* name, ColumnType type, uint32_t size) {
+    schema->offsets[schema->num_columns] = schema->row_size;
+    ColumnDef* column = &schema->columns[schema->num_columns++];
+    strcpy(column->name, name);
+    column->type = type;
+    column->size = size;
+    schema->row_size += column_row_size(column);
+    row_codec_select(schema);
+
+    // Until told otherwise the first column alone is the key
+    if (schema->num_columns == 1) {
+        schema_set_key_columns(schema, 1);
+    }
+}
 
-    if (pager->num_pages == 0) {
-        // New database file. Initialize page 0 as leaf node
-        void* root_node = get_page(pager, 0);
-        initialize_leaf_node(root_node);
-        set_node_root(root_node, true);
+/*
+    The key is made of the leading columns, so each key column sits at the
+    same offset in the normalized key as in the serialized row.
+*/
+void schema_set_key_columns(Schema* schema, uint32_t num_key_columns) {
+    schema->num_key_columns = num_key_columns;
+    schema->key_size = 0;
+    for (Column column = 0; column < num_key_columns; column++) {
+        schema->key_size += schema->columns[column].size;
     }
+}
 
-    return table;
+uint32_t schema_key_mask(Schema* schema) {
+    return COLUMN_MASK(schema->num_key_columns) - 1;
 }
 
-void print_row(Row* row) {
-    printf("(%d, %s, %s)\n", row->id, row->username, row->email);
+bool column_is_integer(ColumnDef* column) {
+    return column->type == COLUMN_TYPE_INT || column->type == COLUMN_TYPE_BIGINT;
 }
 
-void serialize_row(Row* source, void* destination) {
-    memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
-    memcpy(destination + USERNAME_OFFSET, &(source->username), USERNAME_SIZE);
-    memcpy(destination + EMAIL_OFFSET, &(source->email), EMAIL_SIZE);
+// A dictionary column keeps only its code in the row
+uint32_t column_row_size(ColumnDef* column) {
+    return column->type == COLUMN_TYPE_DICT_TEXT ? COLUMN_DICT_CODE_SIZE : column->size;
 }
 
-void deserialize_row(void *source, Row* destination) {
-    memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
-    memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
-    memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
+// Return the position of the named column, or -1 if the schema has none
+int32_t schema_find_column(Schema* schema, const char* name) {
+    for (uint32_t i = 0; i < schema->num_columns; i++) {
+        if (strcmp(schema->columns[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint32_t schema_column_offset(Schema* schema, Column column) {
+    return schema->offsets[column];
+}
+
+void print_batch_row(RowBatch* batch, uint32_t index, Statement* statement) {
+    Schema* schema = &statement->table->schema;
+    fprintf(output_stream(), "(");
+    for (uint32_t i = 0; i < statement->num_columns; i++) {
+        if (i > 0) {
+            fprintf(output_stream(), ", ");
+        }
+        Column column = statement->columns[i];
+        if (column_is_integer(&schema->columns[column])) {
+            fprintf(output_stream(), "%llu", (unsigned long long)batch->columns[column][index].integer);
+        } else {
+            fprintf(output_stream(), "%s", batch->columns[column][index].text);
+        }
+    }
+    fprintf(output_stream(), ")\n");
 }
 
 Cursor* table_start(Table* table) {
-    Cursor* cursor = malloc(sizeof(Cursor));
-    cursor->table = table;
-    cursor->page_num = table->root_page_num;
-    cursor->cell_num = 0;
+    // The smallest possible key lands on cell 0 of the leftmost leaf
+    uint8_t key[TABLE_MAX_KEY_SIZE] = {0};
+    Cursor* cursor = table_find(table, key);
 
-    void* root_node = get_page(table->pager, table->root_page_num);
-    uint32_t num_cells = *leaf_node_num_cells(root_node);
-    cursor->end_of_table = (num_cells == 0);
+    // Every row of the first leaf may be newer than the snapshot
+    cursor->end_of_table = false;
+    if (*leaf_node_num_cells(cursor_leaf(cursor)) == 0) {
+        cursor_next_leaf(cursor);
+    }
 
     return cursor;
 }
 
 /*
-    Return the position of the given key.
+    Descend to the leaf whose key range holds the key, without latching
+    it. Internal nodes are read optimistically (optimistic lock coupling):
+    a node's version is read before the node and validated once the next
+    page has been picked from it, and the descent restarts from the root
+    if a writer changed the node in between. Nothing is written to, so
+    lookups do not contend on the root's cache lines. A page that is
+    internal stays internal, so once its type is validated its key size
+    can be trusted, while a writer may still be changing its cells. The
+    leaf may split before the caller latches it, and only the root turns
+    from a leaf into an internal node.
+*/
+uint32_t table_descend(Table* table, void* key) {
+    Pager* pager = table->pager;
+
+restart:;
+    uint32_t page_num = table->root_page_num;
+    uint64_t version = pager_read_begin(pager, page_num);
+    while (true) {
+        void* node = get_page(pager, page_num);
+        if (get_node_type(node) == NODE_LEAF) {
+            return page_num;
+        }
+        if (!pager_read_validate(pager, page_num, version)) {
+            goto restart;
+        }
+
+        uint32_t next_page_num;
+        if (node_key_beyond(node, key)) {
+            next_page_num = *node_right_link(node);
+        } else {
+            // Bound the child by the key count the search used, however the node changes under it
+            uint32_t num_keys = *internal_node_num_keys(node);
+            uint32_t child_index = internal_node_find_child(node, key);
+            next_page_num = (child_index >= num_keys) ? *internal_node_right_child(node)
+                                                      : *internal_node_cell(node, child_index);
+        }
+        if (!pager_read_validate(pager, page_num, version)) {
+            goto restart;
+        }
+        page_num = next_page_num;
+        version = pager_read_begin(pager, page_num);
+    }
+}
+
+// Descend to the leaf whose key range holds the key and return it latched shared
+uint32_t table_find_leaf(Table* table, void* key) {
+    Pager* pager = table->pager;
+    while (true) {
+        uint32_t page_num = table_descend(table, key);
+        pager_latch(pager, page_num, LATCH_SHARED);
+        if (get_node_type(get_page(pager, page_num)) == NODE_LEAF) {
+            return node_move_right(pager, page_num, key, LATCH_SHARED);
+        }
+        pager_unlatch(pager, page_num);
+    }
+}
+
+// The leaf a cursor reads: its own copy for a snapshot cursor, else the cached page
+void* cursor_leaf(Cursor* cursor) {
+    if (cursor->leaf != NULL) {
+        return cursor->leaf;
+    }
+    return get_page(cursor->table->pager, cursor->page_num);
+}
+
+// Drop the rows inserted after the cursor's snapshot from its copy of the leaf
+void cursor_hide_newer_rows(Cursor* cursor) {
+    VersionStore* versions = &cursor->table->versions;
+    uint32_t key_size = cursor->table->schema.key_size;
+    void* node = cursor->leaf;
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    uint32_t cell_size = leaf_node_cell_size(node);
+
+    uint32_t num_visible = 0;
+    uint8_t key[TABLE_MAX_KEY_SIZE];
+    for (uint32_t i = 0; i < num_cells; i++) {
+        leaf_node_read_key(node, i, key);
+        if (!version_store_visible(versions, key, key_size, cursor->snapshot)) {
+            continue;
+        }
+        if (num_visible != i) {
+            memcpy(leaf_node_cell(node, num_visible), leaf_node_cell(node, i), cell_size);
+        }
+        num_visible++;
+    }
+    *leaf_node_num_cells(node) = num_visible;
+}
+
+/*
+    Copy a page into a snapshot cursor. The page is latched only for the
+    copy, so writers wait for a memcpy rather than for the whole scan. A
+    leaf holding rows newer than the snapshot has them dropped from the
+    copy; most leaves have none and are not looked at any further.
+*/
+void cursor_load_leaf(Cursor* cursor, uint32_t page_num) {
+    Pager* pager = cursor->table->pager;
+    pager_latch(pager, page_num, LATCH_SHARED);
+    memcpy(cursor->leaf, get_page(pager, page_num), PAGE_SIZE);
+    uint64_t newest_row_version = pager->row_versions[page_num];
+    pager_unlatch(pager, page_num);
+
+    cursor->page_num = page_num;
+    cursor->cell_num = 0;
+    if (get_node_type(cursor->leaf) == NODE_LEAF && newest_row_version > cursor->snapshot) {
+        cursor_hide_newer_rows(cursor);
+    }
+}
+
+/*
+    Return the position of the given key in a snapshot of the table.
     If the key is not present, return the position where it should be inserted.
+
+    The cursor sees the rows inserted before it was opened and none after,
+    however long it is kept (snapshot isolation). It reads private copies
+    of the leaves and holds no latch, so inserts run while it is open. A
+    row present when the snapshot was taken is in a leaf that is still
+    ahead of the cursor, or in a copy it has already taken: a split only
+    moves rows from a leaf to its new right sibling.
 */
-Cursor* table_find(Table* table, uint32_t key) {
+Cursor* table_find(Table* table, void* key) {
+    Cursor* cursor = malloc(sizeof(Cursor));
+    cursor->table = table;
+    cursor->latch_mode = LATCH_SHARED;
+    cursor->latched = false;
+    cursor->snapshot = snapshot_open(&table->versions);
+    cursor->leaf = malloc(PAGE_SIZE);
+
+    do {
+        cursor_load_leaf(cursor, table_descend(table, key));
+    } while (get_node_type(cursor->leaf) != NODE_LEAF);
+    while (node_key_beyond(cursor->leaf, key)) {
+        cursor_load_leaf(cursor, *node_right_link(cursor->leaf));
+    }
+    cursor->cell_num = leaf_node_find_cell(cursor->leaf, key);
+    return cursor;
+}
+
+/*
+    Return a cursor at the key, or NULL when the fences or the leaf's bloom
+    filter prove it is absent. Lookups for missing ids then stop without a
+    binary search of the leaf.
+*/
+Cursor* table_find_existing(Table* table, void* key) {
+    Pager* pager = table->pager;
+    uint32_t key_size = table->schema.key_size;
     uint32_t root_page_num = table->root_page_num;
-    void* root_node = get_page(table->pager, root_page_num);
+    void* root = get_page(pager, root_page_num);
+
+    // The root is the rightmost node of its level, so its fences bound the whole tree
+    bool outside_fences;
+    uint64_t version;
+    do {
+        version = pager_read_begin(pager, root_page_num);
+        outside_fences = get_node_type(root) == NODE_INTERNAL &&
+                         pager_read_validate(pager, root_page_num, version) &&
+                         (memcmp(key, internal_node_min_key(root), key_size) < 0 ||
+                          memcmp(key, internal_node_max_key(root), key_size) > 0);
+    } while (!pager_read_validate(pager, root_page_num, version));
+    if (outside_fences) {
+        return NULL;
+    }
+
+    uint32_t page_num = table_find_leaf(table, key);
+    void* node = get_page(pager, page_num);
+    if (!leaf_node_bloom_test(node, key)) {
+        pager_unlatch(pager, page_num);
+        return NULL;
+    }
 
-    if (get_node_type(root_node) == NODE_LEAF) {
-        return leaf_node_find(table, root_page_num, key);
+    Cursor* cursor = leaf_node_find(table, page_num, key);
+    if (cursor->cell_num >= *leaf_node_num_cells(node) ||
+        leaf_node_key_compare(node, cursor->cell_num, key) != 0) {
+        cursor_close(cursor);
+        return NULL;
+    }
+    return cursor;
+}
+
+/*
+    Position a cursor for inserting the key, widening the fences of every
+    internal node on the way down. A key beyond the subtree's fences follows
+    the edge child without a binary search and lands at the edge of the leaf,
+    where it cannot collide. Otherwise *maybe_present reports whether the
+    leaf's bloom filter admits the key, so a caller only compares keys for a
+    duplicate when it has to.
+
+    Nodes are latched shared and coupled on the way down. Only the nodes
+    the insert changes are latched exclusively: the leaf, and an internal
+    node whose fences widen. A node that split since its parent was read
+    is recovered from by moving right. The cursor keeps the leaf latched
+    until it is closed.
+*/
+Cursor* table_find_for_insert(Table* table, void* key, bool* maybe_present) {
+    Pager* pager = table->pager;
+    uint32_t key_size = table->schema.key_size;
+    uint32_t page_num = table->root_page_num;
+    LatchMode mode = LATCH_SHARED;
+    pager_latch(pager, page_num, mode);
+    void* node;
+
+    while (true) {
+        page_num = node_move_right(pager, page_num, key, mode);
+        node = get_page(pager, page_num);
+        bool is_leaf = get_node_type(node) == NODE_LEAF;
+        bool widens = !is_leaf && (memcmp(key, internal_node_max_key(node), key_size) > 0 ||
+                                   memcmp(key, internal_node_min_key(node), key_size) < 0);
+        if ((is_leaf || widens) && mode == LATCH_SHARED) {
+            // The node may split while it is relatched, which moving right again recovers from
+            pager_unlatch(pager, page_num);
+            mode = LATCH_EXCLUSIVE;
+            pager_latch(pager, page_num, mode);
+            continue;
+        }
+        if (is_leaf) {
+            break;
+        }
+
+        uint32_t child_index;
+        if (memcmp(key, internal_node_max_key(node), key_size) > 0) {
+            memcpy(internal_node_max_key(node), key, key_size);
+            child_index = *internal_node_num_keys(node);
+        } else if (memcmp(key, internal_node_min_key(node), key_size) < 0) {
+            memcpy(internal_node_min_key(node), key, key_size);
+            child_index = 0;
+        } else {
+            child_index = internal_node_find_child(node, key);
+        }
+        uint32_t child_page_num = *internal_node_child(node, child_index);
+        LatchMode child_mode = (*internal_node_level(node) == 1) ? LATCH_EXCLUSIVE : LATCH_SHARED;
+        pager_latch(pager, child_page_num, child_mode);
+        pager_unlatch(pager, page_num);
+        page_num = child_page_num;
+        mode = child_mode;
+    }
+
+    Cursor* cursor;
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (num_cells > 0 && leaf_node_key_compare(node, num_cells - 1, key) > 0) {
+        *maybe_present = false;
+        cursor = malloc(sizeof(Cursor));
+        cursor->table = table;
+        cursor->page_num = page_num;
+        cursor->cell_num = num_cells;
+        cursor->end_of_table = true;
+        cursor->leaf = NULL;
     } else {
-        return internal_node_find(table, root_page_num, key);
+        *maybe_present = leaf_node_bloom_test(node, key);
+        cursor = leaf_node_find(table, page_num, key);
     }
+
+    cursor->latch_mode = LATCH_EXCLUSIVE;
+    cursor->latched = true;
+    return cursor;
 }
 
 void* cursor_value(Cursor* cursor) {
-    uint32_t page_num = cursor->page_num;
-    void* page = get_page(cursor->table->pager, page_num);
-    return leaf_node_value(page, cursor->cell_num);
+    return leaf_node_value(cursor_leaf(cursor), cursor->cell_num);
+}
+
+// Release the cursor's latch or snapshot and free it
+void cursor_close(Cursor* cursor) {
+    if (cursor->latched) {
+        pager_unlatch(cursor->table->pager, cursor->page_num);
+    }
+    if (cursor->leaf != NULL) {
+        free(cursor->leaf);
+        snapshot_close(&cursor->table->versions, cursor->snapshot);
+    }
+    free(cursor);
+}
+
+/*
+    Move the cursor to the first cell of the next leaf with rows in it,
+    through the right links. A latched cursor latches the next leaf before
+    the current one is let go, so a split in between cannot hide rows from
+    the scan. A snapshot cursor follows the link of its copy instead.
+*/
+void cursor_next_leaf(Cursor* cursor) {
+    Pager* pager = cursor->table->pager;
+    do {
+        uint32_t next_page_num = *node_right_link(cursor_leaf(cursor));
+        if (next_page_num == 0) {
+            cursor->end_of_table = true;
+            return;
+        }
+
+        if (cursor->leaf != NULL) {
+            cursor_load_leaf(cursor, next_page_num);
+        } else {
+            pager_latch(pager, next_page_num, cursor->latch_mode);
+            pager_unlatch(pager, cursor->page_num);
+            cursor->page_num = next_page_num;
+            cursor->cell_num = 0;
+        }
+    } while (*leaf_node_num_cells(cursor_leaf(cursor)) == 0);
 }
 
 void cursor_advance(Cursor* cursor) {
-    uint32_t page_num = cursor->page_num;
-    void* node = get_page(cursor->table->pager, page_num);
+    void* node = cursor_leaf(cursor);
 
     cursor->cell_num += 1;
     if (cursor->cell_num >= (*leaf_node_num_cells(node))) {
-        cursor->end_of_table = true;
+        cursor_next_leaf(cursor);
+    }
+}
+
+// Skip count rows, stepping over whole leaves by their cell counts
+void cursor_skip(Cursor* cursor, uint32_t count) {
+    while (!cursor->end_of_table && count > 0) {
+        void* node = cursor_leaf(cursor);
+        uint32_t remaining_in_leaf = *leaf_node_num_cells(node) - cursor->cell_num;
+
+        if (count < remaining_in_leaf) {
+            cursor->cell_num += count;
+            return;
+        }
+
+        count -= remaining_in_leaf;
+        cursor_next_leaf(cursor);
+    }
+}
+
+/*
+    Fill the batch with up to max_rows (at most SCAN_BATCH_SIZE) rows
+    starting at the cursor, all from one leaf. The leaf is consumed with
+    one tight loop per requested column; string columns are handed out as
+    pointers into the cursor's leaf instead of being copied, and key columns
+    are decoded from the cell's key so a key-only scan never touches the
+    row bytes. The cursor keeps that leaf, its copy or its latch, until the
+    next call, so those pointers stay valid while the batch is consumed.
+    Returns the number of rows placed in the batch.
+*/
+uint32_t cursor_next_batch(Cursor* cursor, RowBatch* batch, uint32_t column_mask, uint32_t max_rows) {
+    Schema* schema = &cursor->table->schema;
+    batch->num_rows = 0;
+    if (max_rows > SCAN_BATCH_SIZE) {
+        max_rows = SCAN_BATCH_SIZE;
+    }
+
+    if (!cursor->end_of_table &&
+        cursor->cell_num >= *leaf_node_num_cells(cursor_leaf(cursor))) {
+        cursor_next_leaf(cursor);
+    }
+
+    if (!cursor->end_of_table && max_rows > 0) {
+        void* node = cursor_leaf(cursor);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+
+        uint32_t count = num_cells - cursor->cell_num;
+        if (count > max_rows) {
+            count = max_rows;
+        }
+
+        void* cells = leaf_node_cell(node, cursor->cell_num);
+        uint32_t cell_size = leaf_node_cell_size(node);
+        uint32_t suffix_size = leaf_node_suffix_size(node);
+        for (Column column = 0; column < schema->num_columns; column++) {
+            if (!(column_mask & COLUMN_MASK(column))) {
+                continue;
+            }
+            BatchValue* values = batch->columns[column] + batch->num_rows;
+            uint32_t size = schema->columns[column].size;
+            if (column < schema->num_key_columns) {
+                // Reassemble each key behind the leaf's shared prefix
+                uint8_t key[TABLE_MAX_KEY_SIZE];
+                uint32_t prefix_size = *leaf_node_prefix_size(node);
+                memcpy(key, leaf_node_prefix(node), prefix_size);
+                uint8_t* suffix = cells;
+                for (uint32_t i = 0; i < count; i++) {
+                    memcpy(key + prefix_size, suffix, suffix_size);
+                    values[i].integer = decode_big_endian(key + schema->offsets[column], size);
+                    suffix += cell_size;
+                }
+                continue;
+            }
+
+            void* value = cells + suffix_size + schema_column_offset(schema, column);
+            Dictionary* dictionary = cursor->table->dictionaries[column];
+            if (column_is_integer(&schema->columns[column])) {
+                for (uint32_t i = 0; i < count; i++) {
+                    values[i].integer = decode_native_int(value, size);
+                    value += cell_size;
+                }
+            } else if (dictionary != NULL) {
+                // Codes index the interned strings; nothing is copied
+                for (uint32_t i = 0; i < count; i++) {
+                    values[i].text = dictionary->values[decode_native_int(value, COLUMN_DICT_CODE_SIZE)];
+                    value += cell_size;
+                }
+            } else {
+                for (uint32_t i = 0; i < count; i++) {
+                    values[i].text = value;
+                    value += cell_size;
+                }
+            }
+        }
+
+        batch->num_rows += count;
+        cursor->cell_num += count;
+    }
+
+    return batch->num_rows;
+}
+
+// Sum cell counts leaf by leaf without deserializing any row
+uint32_t table_count(Table* table) {
+    Cursor* cursor = table_start(table);
+    uint32_t count = 0;
+
+    while (!cursor->end_of_table) {
+        void* node = cursor_leaf(cursor);
+        count += *leaf_node_num_cells(node) - cursor->cell_num;
+        cursor_next_leaf(cursor);
+    }
+
+    cursor_close(cursor);
+    return count;
+}
+
+// Add up the leading key column of every leaf
+uint64_t table_sum_keys(Table* table) {
+    uint32_t size = table->schema.columns[KEY_COLUMN].size;
+    Cursor* cursor = table_start(table);
+    uint64_t sum = 0;
+
+    while (!cursor->end_of_table) {
+        void* node = cursor_leaf(cursor);
+        uint32_t num_cells = *leaf_node_num_cells(node);
+        uint8_t key[TABLE_MAX_KEY_SIZE];
+        for (uint32_t i = 0; i < num_cells; i++) {
+            leaf_node_read_key(node, i, key);
+            sum += decode_big_endian(key, size);
+        }
+        cursor_next_leaf(cursor);
+    }
+
+    cursor_close(cursor);
+    return sum;
+}
+
+// Keys order by their leading column first, so its extremes sit in the edge leaves
+bool table_min_key(Table* table, uint64_t* key) {
+    uint32_t page_num = edge_leaf_page_num(table->pager, table->root_page_num, false);
+    void* node = get_page(table->pager, page_num);
+    bool found = *leaf_node_num_cells(node) > 0;
+    if (found) {
+        uint8_t min_key[TABLE_MAX_KEY_SIZE];
+        leaf_node_read_key(node, 0, min_key);
+        *key = key_column_decode(&table->schema, min_key, KEY_COLUMN);
+    }
+    pager_unlatch(table->pager, page_num);
+    return found;
+}
+
+bool table_max_key(Table* table, uint64_t* key) {
+    uint32_t page_num = edge_leaf_page_num(table->pager, table->root_page_num, true);
+    void* node = get_page(table->pager, page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (num_cells > 0) {
+        uint8_t max_key[TABLE_MAX_KEY_SIZE];
+        leaf_node_read_key(node, num_cells - 1, max_key);
+        *key = key_column_decode(&table->schema, max_key, KEY_COLUMN);
+    }
+    pager_unlatch(table->pager, page_num);
+    return num_cells > 0;
+}
+
+/*
+    Compute an aggregate from the row store. The key column has the shortcuts
+    above; any other column is read a batch at a time. Returns false if the
+    table is empty and the aggregate is not count.
+*/
+bool table_aggregate(Table* table, Aggregate aggregate, Column column, uint64_t* result) {
+    if (aggregate == AGGREGATE_COUNT) {
+        *result = table_count(table);
+        return true;
+    }
+    if (column == KEY_COLUMN && aggregate == AGGREGATE_MIN) {
+        return table_min_key(table, result);
+    }
+    if (column == KEY_COLUMN && aggregate == AGGREGATE_MAX) {
+        return table_max_key(table, result);
+    }
+    if (column == KEY_COLUMN) {
+        if (!table_min_key(table, result)) {
+            return false;
+        }
+        *result = table_sum_keys(table);
+        return true;
+    }
+
+    RowBatch* batch = malloc(sizeof(RowBatch));
+    Cursor* cursor = table_start(table);
+    bool has_result = false;
+    *result = (aggregate == AGGREGATE_MIN) ? UINT64_MAX : 0;
+    while (cursor_next_batch(cursor, batch, COLUMN_MASK(column), SCAN_BATCH_SIZE) > 0) {
+        BatchValue* values = batch->columns[column];
+        for (uint32_t i = 0; i < batch->num_rows; i++) {
+            uint64_t value = values[i].integer;
+            if (aggregate == AGGREGATE_SUM) {
+                *result += value;
+            } else if ((aggregate == AGGREGATE_MIN) ? value < *result : value > *result) {
+                *result = value;
+            }
+        }
+        has_result = true;
     }
+    cursor_close(cursor);
+    free(batch);
+    return has_result;
 }
@@ -0,0 +1,109 @@
+#include "../include/db.h"
+
+/*
+    Multi-version concurrency control. Every insert gets the next version
+    of its table, and a scan opens a snapshot: the version of the last
+    insert when it started. The scan sees exactly the rows whose version
+    is no newer than its snapshot. Rows are only ever inserted, so a row's
+    version chain is just the version of its insert, and it lives here in
+    memory rather than on the row's page: it is recorded only while some
+    open snapshot is older than it, and a row without a recorded version
+    is visible to every snapshot.
+*/
+
+void version_store_init(VersionStore* store) {
+    pthread_mutex_init(&store->lock, NULL);
+    store->last_version = 0;
+    store->num_snapshots = 0;
+    for (uint32_t i = 0; i < VERSION_STORE_BUCKETS; i++) {
+        store->buckets[i] = NULL;
+    }
+}
+
+// Forget the versions no open snapshot can be older than
+void version_store_prune(VersionStore* store, uint64_t oldest_snapshot) {
+    for (uint32_t i = 0; i < VERSION_STORE_BUCKETS; i++) {
+        RowVersion** link = &store->buckets[i];
+        while (*link != NULL) {
+            RowVersion* row_version = *link;
+            if (row_version->version <= oldest_snapshot) {
+                *link = row_version->next;
+                free(row_version);
+            } else {
+                link = &row_version->next;
+            }
+        }
+    }
+}
+
+void version_store_free(VersionStore* store) {
+    version_store_prune(store, UINT64_MAX);
+}
+
+/*
+    Give an insert its version. The caller holds the row's leaf latched
+    exclusively until the row is written, so a snapshot opened after this
+    is taken waits for the row, and one opened before finds its version.
+*/
+uint64_t version_store_stamp(VersionStore* store, void* key, uint32_t key_size) {
+    pthread_mutex_lock(&store->lock);
+    uint64_t version = ++store->last_version;
+    if (store->num_snapshots > 0) {
+        RowVersion* row_version = malloc(sizeof(RowVersion));
+        memcpy(row_version->key, key, key_size);
+        row_version->version = version;
+        uint32_t bucket = hash_bytes(key, key_size) % VERSION_STORE_BUCKETS;
+        row_version->next = store->buckets[bucket];
+        store->buckets[bucket] = row_version;
+    }
+    pthread_mutex_unlock(&store->lock);
+    return version;
+}
+
+// Whether a snapshot sees the row with this key
+bool version_store_visible(VersionStore* store, void* key, uint32_t key_size, uint64_t snapshot) {
+    pthread_mutex_lock(&store->lock);
+    bool visible = true;
+    uint32_t bucket = hash_bytes(key, key_size) % VERSION_STORE_BUCKETS;
+    for (RowVersion* row_version = store->buckets[bucket]; row_version != NULL; row_version = row_version->next) {
+        if (memcmp(row_version->key, key, key_size) == 0) {
+            visible = row_version->version <= snapshot;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&store->lock);
+    return visible;
+}
+
+uint64_t snapshot_open(VersionStore* store) {
+    pthread_mutex_lock(&store->lock);
+    if (store->num_snapshots == VERSION_MAX_SNAPSHOTS) {
+        printf("Too many open snapshots.\n");
+        exit(EXIT_FAILURE);
+    }
+    uint64_t snapshot = store->last_version;
+    store->snapshots[store->num_snapshots++] = snapshot;
+    pthread_mutex_unlock(&store->lock);
+    return snapshot;
+}
+
+void snapshot_close(VersionStore* store, uint64_t snapshot) {
+    pthread_mutex_lock(&store->lock);
+    for (uint32_t i = 0; i < store->num_snapshots; i++) {
+        if (store->snapshots[i] == snapshot) {
+            store->snapshots[i] = store->snapshots[--store->num_snapshots];
+            break;
+        }
+    }
+    uint64_t oldest_snapshot = UINT64_MAX;
+    for (uint32_t i = 0; i < store->num_snapshots; i++) {
+        if (store->snapshots[i] < oldest_snapshot) {
+            oldest_snapshot = store->snapshots[i];
+        }
+    }
+    // Only the oldest snapshot going away lets versions be forgotten
+    if (snapshot < oldest_snapshot) {
+        version_store_prune(store, oldest_snapshot);
+    }
+    pthread_mutex_unlock(&store->lock);
+}
@@ -0,0 +1,243 @@
+#include "../include/db.h"
+
+/*
+    Write-ahead log. A commit appends the images of the pages it changed
+    to <db>-wal and syncs the log instead of the file, so it costs one
+    sequential write. The logged images become the pages' shadows, and a
+    background checkpointer trickles them into the file a few pages per
+    tick, in page order, never before the log holding them is durable.
+    Once every logged page is in the file and the file is synced, the log
+    is truncated. Opening the database replays the committed frames left
+    by a crash; closing it writes the rest and removes the log. A
+    compressed file is rewritten whole instead, bypassing the log.
+*/
+
+uint32_t* wal_frame_page_num(void* frame) {
+    return frame + WAL_FRAME_PAGE_NUM_OFFSET;
+}
+
+uint32_t* wal_frame_commit(void* frame) {
+    return frame + WAL_FRAME_COMMIT_OFFSET;
+}
+
+uint64_t* wal_frame_lsn(void* frame) {
+    return frame + WAL_FRAME_LSN_OFFSET;
+}
+
+void wal_truncate(Pager* pager) {
+    if (ftruncate(pager->log_fd, 0) == -1) {
+        printf("Error truncating log: %d\n", errno);
+        exit(EXIT_FAILURE);
+    }
+    pager->checkpoint_lsn = pager->next_lsn;
+}
+
+/*
+    Put back the pages of every transaction the log holds whole. Frames
+    are numbered consecutively, so the first one out of sequence, or cut
+    short, ends the log; frames after the last commit frame are dropped.
+*/
+void wal_recover(Pager* pager) {
+    uint8_t* frame = malloc(WAL_FRAME_SIZE);
+    off_t committed_length = 0;
+    uint64_t first_lsn = 0;
+    for (uint64_t i = 0;; i++) {
+        off_t offset = (off_t)i * WAL_FRAME_SIZE;
+        if (pread(pager->log_fd, frame, WAL_FRAME_SIZE, offset) != WAL_FRAME_SIZE) {
+            break;
+        }
+        if (i == 0) {
+            first_lsn = *wal_frame_lsn(frame);
+        }
+        if (*wal_frame_lsn(frame) != first_lsn + i) {
+            break;
+        }
+        if (*wal_frame_commit(frame)) {
+            committed_length = offset + WAL_FRAME_SIZE;
+        }
+    }
+
+    for (off_t offset = 0; offset < committed_length; offset += WAL_FRAME_SIZE) {
+        pread(pager->log_fd, frame, WAL_FRAME_SIZE, offset);
+        uint32_t page_num = *wal_frame_page_num(frame);
+        if (page_num >= TABLE_MAX_PAGES) {
+            printf("Log frame is for a page past the end of the database. Corrupt log.\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(get_page(pager, page_num), frame + WAL_FRAME_HEADER_SIZE, PAGE_SIZE);
+    }
+    free(frame);
+
+    if (committed_length > 0) {
+        pager_write_back(pager);
+        pager_sync(pager, pager->file_descriptor);
+    }
+    wal_truncate(pager);
+}
+
+// Write up to a tick's worth of pages whose logged image is durable
+void wal_checkpoint_pages(Pager* pager) {
+    uint32_t written = 0;
+    while (pager->checkpoint_page < TABLE_MAX_PAGES && written < CHECKPOINT_PAGES_PER_TICK) {
+        uint32_t page_num = pager->checkpoint_page++;
+        if (pager->unwritten[page_num] && pager->page_lsns[page_num] < pager->synced_lsn) {
+            pager_write(pager, (off_t)page_num * PAGE_SIZE, pager->shadows[page_num], PAGE_SIZE);
+            pager->unwritten[page_num] = false;
+            written++;
+        }
+    }
+    if (pager->checkpoint_page < TABLE_MAX_PAGES) {
+        return;
+    }
+
+    // End of a sweep: drop the log if the file holds all of it
+    pager->checkpoint_page = 0;
+    if (pager->next_lsn == pager->checkpoint_lsn) {
+        return;
+    }
+    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
+        if (pager->unwritten[i]) {
+            return;
+        }
+    }
+    uint64_t lsn = pager->next_lsn;
+    pthread_mutex_unlock(&pager->checkpoint_lock);
+    pager_sync(pager, pager->file_descriptor);
+    pthread_mutex_lock(&pager->checkpoint_lock);
+    // A commit in the meantime logged pages the file does not hold yet
+    if (pager->next_lsn == lsn) {
+        wal_truncate(pager);
+    }
+}
+
+void* wal_checkpointer(void* argument) {
+    Pager* pager = argument;
+    pthread_mutex_lock(&pager->checkpoint_lock);
+    while (!pager->stopping_checkpointer) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += CHECKPOINT_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&pager->checkpoint_wake, &pager->checkpoint_lock, &deadline);
+        if (!pager->stopping_checkpointer && !pager->compress && !pager->mapped) {
+            wal_checkpoint_pages(pager);
+        }
+    }
+    pthread_mutex_unlock(&pager->checkpoint_lock);
+    return NULL;
+}
+
+void wal_open(Pager* pager, const char* filename) {
+    size_t length = strlen(filename);
+    pager->log_path = malloc(length + sizeof("-wal"));
+    memcpy(pager->log_path, filename, length);
+    strcpy(pager->log_path + length, "-wal");
+    pager->log_fd = open(pager->log_path, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+    if (pager->log_fd == -1) {
+        printf("Unable to open log file\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&pager->checkpoint_lock, NULL);
+    pthread_cond_init(&pager->checkpoint_wake, NULL);
+    pager->stopping_checkpointer = false;
+    pager->next_lsn = 1;
+    pager->synced_lsn = 1;
+    pager->checkpoint_lsn = 1;
+    pager->checkpoint_page = 0;
+    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
+        pager->page_lsns[i] = 0;
+        pager->unwritten[i] = false;
+    }
+
+    wal_recover(pager);
+
+    // Signals are left to the threads that expect them, such as the server's event loop
+    sigset_t signals, previous;
+    sigfillset(&signals);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+    pthread_create(&pager->checkpointer, NULL, wal_checkpointer, pager);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+/*
+    Log the dirty pages, the last frame marking a commit, and make them
+    the pages' shadows. With sync the log is made durable before this
+    returns; without, the frames reach disk with a later commit or close.
+*/
+void wal_log_dirty_pages(Pager* pager, bool sync) {
+    pthread_mutex_lock(&pager->checkpoint_lock);
+    if (pager->compress || pager->mapped) {
+        // The file is about to hold every page
+        for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
+            pager->unwritten[i] = false;
+        }
+        wal_truncate(pager);
+        pager_write_back(pager);
+        pthread_mutex_unlock(&pager->checkpoint_lock);
+        if (sync) {
+            pager_sync(pager, pager->file_descriptor);
+        }
+        return;
+    }
+
+    uint32_t num_frames = 0;
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        if (pager_page_dirty(pager, i)) {
+            num_frames++;
+        }
+    }
+    uint8_t* frames = calloc(num_frames, WAL_FRAME_SIZE);
+    uint8_t* frame = frames;
+    for (uint32_t i = 0; i < pager->num_pages; i++) {
+        if (!pager_page_dirty(pager, i)) {
+            continue;
+        }
+        *wal_frame_page_num(frame) = i;
+        *wal_frame_lsn(frame) = pager->next_lsn;
+        memcpy(frame + WAL_FRAME_HEADER_SIZE, pager->pages[i], PAGE_SIZE);
+        pager_mark_clean(pager, i, pager->pages[i]);
+        pager->page_lsns[i] = pager->next_lsn++;
+        pager->unwritten[i] = true;
+        frame += WAL_FRAME_SIZE;
+    }
+    if (num_frames > 0) {
+        *wal_frame_commit(frame - WAL_FRAME_SIZE) = true;
+        off_t offset = (off_t)(pager->next_lsn - num_frames - pager->checkpoint_lsn) * WAL_FRAME_SIZE;
+        if (pwrite(pager->log_fd, frames, (size_t)num_frames * WAL_FRAME_SIZE, offset) == -1) {
+            printf("Error writing log: %d\n", errno);
+            exit(EXIT_FAILURE);
+        }
+    }
+    free(frames);
+    uint64_t lsn = pager->next_lsn;
+    if (pager->synchronous == SYNCHRONOUS_OFF) {
+        pager->synced_lsn = lsn;
+    }
+    pthread_mutex_unlock(&pager->checkpoint_lock);
+
+    if (sync && pager->synchronous != SYNCHRONOUS_OFF) {
+        pager_sync(pager, pager->log_fd);
+        pthread_mutex_lock(&pager->checkpoint_lock);
+        pager->synced_lsn = lsn;
+        pthread_mutex_unlock(&pager->checkpoint_lock);
+    }
+}
+
+void wal_stop_checkpointer(Pager* pager) {
+    pthread_mutex_lock(&pager->checkpoint_lock);
+    pager->stopping_checkpointer = true;
+    pthread_cond_signal(&pager->checkpoint_wake);
+    pthread_mutex_unlock(&pager->checkpoint_lock);
+    pthread_join(pager->checkpointer, NULL);
+}
+
+// Once the file holds every page, and is synced, the log has nothing left to replay
+void wal_remove(Pager* pager) {
+    close(pager->log_fd);
+    unlink(pager->log_path);
+    free(pager->log_path);
+}